@@ -296,8 +296,25 @@ function(unittest_three_screenshots)
 
 endfunction()
 
+# By default the SDL2 output must match the reference exactly. Examples that
+# need a tolerance can pass the arguments MAX_RMS and MAX_PEAK (in 16-bit
+# units).
+#
+# The emulator output is compared exactly. Examples that don't have a reference
+# recorded with the emulator can skip that test with the option SDL2_ONLY.
+
 function(unittest_audio)
 
+    cmake_parse_arguments(ARG "SDL2_ONLY" "MAX_RMS;MAX_PEAK" "" ${ARGN})
+
+    if(NOT DEFINED ARG_MAX_RMS)
+        set(ARG_MAX_RMS 0)
+    endif()
+
+    if(NOT DEFINED ARG_MAX_PEAK)
+        set(ARG_MAX_PEAK 0)
+    endif()
+
     # Get name of the folder we are in
     # --------------------------------
 
@@ -317,7 +334,8 @@ function(unittest_audio)
     endif()
 
     set(CMD1 "$<TARGET_FILE:${EXECUTABLE_NAME}> --lua ${TEST_SCRIPT}")
-    set(CMD2 "${CMAKE_COMMAND} -E compare_files ${REF_WAV} audio.wav")
+    set(CMD2 "$<TARGET_FILE:wavmatch> ${REF_WAV} audio.wav")
+    set(CMD2 "${CMD2} --max-rms ${ARG_MAX_RMS} --max-peak ${ARG_MAX_PEAK}")
 
     add_test(NAME ${EXECUTABLE_NAME}_test
         COMMAND ${CMAKE_COMMAND}
@@ -330,7 +348,7 @@ function(unittest_audio)
     # Emulator test
     # -------------
 
-    if(BUILD_GBA)
+    if(BUILD_GBA AND NOT ARG_SDL2_ONLY)
         set(TEST_SCRIPT "${CMAKE_CURRENT_SOURCE_DIR}/test-gba.lua")
         if(NOT EXISTS ${TEST_SCRIPT})
             set(TEST_SCRIPT "${CMAKE_CURRENT_SOURCE_DIR}/test.lua")
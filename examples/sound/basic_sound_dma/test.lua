@@ -3,6 +3,10 @@
 wav_record_start()
 run_frames_and_pause(60)
 wav_record_end()
+
+-- Print the number of transfers done by the DMA channel that feeds the FIFO
+dma_stats(1)
+
 exit()
 
 return 0
@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+// Example of how to use the four PSG channels. Channel 1 plays a rising sweep
+// on the left speaker, channel 2 plays an arpeggio on the right speaker,
+// channel 3 plays a bass line from a triangle wave stored in wave RAM, and
+// channel 4 plays short bursts of noise. Note that the GBA only has one
+// speaker, it is needed to use headphones to hear the difference.
+
+#include <ugba/ugba.h>
+
+// Frequency value of channels 1 and 2 for a given frequency in Hz
+#define SQUARE_FREQ(hz)     (2048 - (131072 / (hz)))
+
+// Sample rate value of channel 3 for a note in Hz of a 32-sample wave
+#define WAVE_FREQ(hz)       (2048 - (65536 / (hz)))
+
+static const uint16_t arpeggio[] = {
+    SQUARE_FREQ(523), SQUARE_FREQ(659), SQUARE_FREQ(784), SQUARE_FREQ(1047)
+};
+
+static const uint16_t bass[] = {
+    WAVE_FREQ(131), WAVE_FREQ(98)
+};
+
+static void load_wave_ram(void)
+{
+    // While bank 0 is selected, the CPU writes to bank 1. After filling it,
+    // bank 1 is selected so that it is the one that is played.
+    REG_SOUND3CNT_L = SOUND3CNT_L_DISABLE | SOUND3CNT_L_BANK(0);
+
+    // Triangle wave with 32 4-bit samples, two per byte
+    uint8_t wave[16];
+    for (int i = 0; i < 8; i++)
+    {
+        wave[i] = ((i * 2) << 4) | (i * 2 + 1);
+        wave[15 - i] = ((i * 2 + 1) << 4) | (i * 2);
+    }
+
+    for (int i = 0; i < 8; i++)
+        REG_WAVE_RAM[i] = wave[i * 2] | (wave[i * 2 + 1] << 8);
+
+    REG_SOUND3CNT_L = SOUND3CNT_L_ENABLE | SOUND3CNT_L_BANK(1)
+                    | SOUND3CNT_L_SIZE_32;
+}
+
+static void play_sweep(void)
+{
+    REG_SOUND1CNT_L = SOUND1CNT_L_SWEEP_SHIFT(6) | SOUND1CNT_L_SWEEP_DIR_INC
+                    | SOUND1CNT_L_SWEEP_TIME(3);
+    REG_SOUND1CNT_H = SOUND1CNT_H_WAVE_DUTY_50 | SOUND1CNT_H_ENV_VOLUME(15)
+                    | SOUND1CNT_H_ENV_DIR_DEC | SOUND1CNT_H_ENV_STEP_TIME(2);
+    REG_SOUND1CNT_X = SOUND1CNT_X_FREQUENCY(SQUARE_FREQ(262))
+                    | SOUND1CNT_X_RESTART;
+}
+
+static void play_arpeggio(int note)
+{
+    REG_SOUND2CNT_L = SOUND2CNT_L_WAVE_DUTY_25 | SOUND2CNT_L_ENV_VOLUME(12)
+                    | SOUND2CNT_L_ENV_DIR_DEC | SOUND2CNT_L_ENV_STEP_TIME(1)
+                    | SOUND2CNT_L_LENGTH(32);
+    REG_SOUND2CNT_H = SOUND2CNT_H_FREQUENCY(arpeggio[note])
+                    | SOUND2CNT_H_ONE_SHOT | SOUND2CNT_H_RESTART;
+}
+
+static void play_bass(int note)
+{
+    REG_SOUND3CNT_H = SOUND3CNT_H_VOLUME_100;
+    REG_SOUND3CNT_X = SOUND3CNT_X_SAMPLE_RATE(bass[note])
+                    | SOUND3CNT_X_RESTART;
+}
+
+static void play_noise(void)
+{
+    REG_SOUND4CNT_L = SOUND4CNT_L_ENV_VOLUME(10) | SOUND4CNT_L_ENV_DIR_DEC
+                    | SOUND4CNT_L_ENV_STEP_TIME(1);
+    REG_SOUND4CNT_H = SOUND4CNT_H_DIV_RATIO(1) | SOUND4CNT_H_FREQUENCY(2)
+                    | SOUND4CNT_H_WIDTH_15_BITS | SOUND4CNT_H_RESTART;
+}
+
+int main(int argc, char *argv[])
+{
+    UGBA_Init(&argc, &argv);
+
+    IRQ_Enable(IRQ_VBLANK);
+
+    DISP_ModeSet(0);
+
+    CON_InitDefault();
+
+    CON_Print("PSG channels");
+
+    // The sound hardware needs to be enabled to write to any other register.
+    SOUND_MasterEnable(1);
+
+    REG_SOUNDCNT_L = SOUNDCNT_L_PSG_VOL_LEFT(7) | SOUNDCNT_L_PSG_VOL_RIGHT(7)
+                   | SOUNDCNT_L_PSG_1_ENABLE_LEFT
+                   | SOUNDCNT_L_PSG_2_ENABLE_RIGHT
+                   | SOUNDCNT_L_PSG_3_ENABLE_LEFT
+                   | SOUNDCNT_L_PSG_3_ENABLE_RIGHT
+                   | SOUNDCNT_L_PSG_4_ENABLE_LEFT
+                   | SOUNDCNT_L_PSG_4_ENABLE_RIGHT;
+    REG_SOUNDCNT_H = SOUNDCNT_H_PSG_VOLUME_100;
+
+    load_wave_ram();
+
+    uint32_t frame = 0;
+
+    while (1)
+    {
+        if ((frame % 30) == 0)
+        {
+            play_sweep();
+            play_bass((frame / 30) % 2);
+        }
+
+        if ((frame % 15) == 0)
+            play_noise();
+
+        if ((frame % 8) == 0)
+            play_arpeggio((frame / 8) % 4);
+
+        frame++;
+
+        SWI_VBlankIntrWait();
+    }
+
+    return 0;
+}
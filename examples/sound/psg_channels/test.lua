@@ -0,0 +1,8 @@
+-- Test that records 1 second of audio and compares it with the reference
+
+wav_record_start()
+run_frames_and_pause(60)
+wav_record_end()
+exit()
+
+return 0
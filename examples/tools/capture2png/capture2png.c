@@ -0,0 +1,347 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+// Converts a capture file saved by the SDL2 port of libugba to a sequence of
+// PNG files and, optionally, a WAV file with the audio.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <png.h>
+
+#if !defined(PNG_SIMPLIFIED_WRITE_SUPPORTED)
+# error "This code needs libpng 1.6"
+#endif
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint16_t width;
+    uint16_t height;
+    uint32_t clocks_per_second;
+    uint32_t clocks_per_frame;
+    uint32_t sample_rate;
+    uint16_t num_channels;
+    uint16_t bits_per_sample;
+    uint32_t keyframe_interval;
+    uint32_t num_frames;
+    uint32_t num_samples;
+} capture_header_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t size;
+} capture_chunk_t;
+
+typedef struct {
+    uint32_t chunk_id;
+    uint32_t chunk_size;
+    uint32_t format;
+    uint32_t subchunk_1_id;
+    uint32_t subchunk_1_size;
+    uint16_t audio_format;
+    uint16_t num_channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+    uint32_t subchunk_2_id;
+    uint32_t subchunk_2_size;
+} wav_header_t;
+#pragma pack(pop)
+
+#define CAPTURE_MAGIC           (0x43424755)
+#define CAPTURE_VERSION         (1)
+
+#define CAPTURE_CHUNK_KEY       (0x59454B46) // "FKEY"
+#define CAPTURE_CHUNK_DELTA     (0x544C4446) // "FDLT"
+#define CAPTURE_CHUNK_AUDIO     (0x50445541) // "AUDP"
+
+// Returns 0 on success, 1 if the data is corrupted
+static int Decode_RLE(const uint16_t *src, size_t src_count,
+                      uint16_t *dst, size_t dst_count)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < src_count)
+    {
+        uint16_t token = src[in++];
+        size_t count = token & 0x7FFF;
+
+        if (out + count > dst_count)
+            return 1;
+
+        if (token & 0x8000)
+        {
+            if (in == src_count)
+                return 1;
+
+            uint16_t value = src[in++];
+            for (size_t i = 0; i < count; i++)
+                dst[out++] = value;
+        }
+        else
+        {
+            if (in + count > src_count)
+                return 1;
+
+            memcpy(&dst[out], &src[in], count * sizeof(uint16_t));
+            in += count;
+            out += count;
+        }
+    }
+
+    if (out != dst_count)
+        return 1;
+
+    return 0;
+}
+
+static int Save_PNG(const char *filename, const uint16_t *frame,
+                    int width, int height, uint8_t *rgb)
+{
+    for (int i = 0; i < width * height; i++)
+    {
+        uint32_t data = frame[i];
+        *rgb++ = (data & 0x1F) << 3;
+        *rgb++ = (data & (0x1F << 5)) >> 2;
+        *rgb++ = (data & (0x1F << 10)) >> 7;
+    }
+    rgb -= width * height * 3;
+
+    png_image image;
+
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    image.width = width;
+    image.height = height;
+    image.format = PNG_FORMAT_RGB;
+
+    if (!png_image_write_to_file(&image, filename, 0, rgb, 0, NULL))
+    {
+        printf("%s(): png_image_write_to_file(): %s\n", __func__,
+               image.message);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void Save_WAV_Header(FILE *f, const capture_header_t *capture,
+                            uint32_t data_size)
+{
+    uint32_t channels = capture->num_channels;
+    uint32_t bits = capture->bits_per_sample;
+
+    wav_header_t header = {
+        .chunk_id = 0x46464952,
+        .chunk_size = data_size + sizeof(wav_header_t) - 8,
+        .format = 0x45564157,
+
+        .subchunk_1_id = 0x20746D66,
+        .subchunk_1_size = 16,
+        .audio_format = 1,
+        .num_channels = channels,
+        .sample_rate = capture->sample_rate,
+        .byte_rate = capture->sample_rate * channels * bits / 8,
+        .block_align = channels * bits / 8,
+        .bits_per_sample = bits,
+
+        .subchunk_2_id = 0x61746164,
+        .subchunk_2_size = data_size,
+    };
+
+    fseek(f, 0, SEEK_SET);
+
+    if (fwrite(&header, sizeof(header), 1, f) != 1)
+        printf("Failed to write WAV header\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if ((argc != 3) && (argc != 4))
+    {
+        printf("Usage: %s capture.ugbc prefix [audio.wav]\n"
+               "Frames are saved as prefixNNNNNN.png\n",
+               argv[0]);
+
+        return 2;
+    }
+
+    int ret = 1;
+
+    FILE *f = NULL;
+    FILE *wav = NULL;
+    uint16_t *frame = NULL;
+    uint16_t *delta = NULL;
+    uint8_t *rgb = NULL;
+    uint8_t *data = NULL;
+    size_t data_capacity = 0;
+    char *name = NULL;
+    uint32_t audio_size = 0;
+
+    f = fopen(argv[1], "rb");
+    if (f == NULL)
+    {
+        printf("Can't open %s\n", argv[1]);
+        goto cleanup;
+    }
+
+    capture_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1)
+    {
+        printf("Can't read header\n");
+        goto cleanup;
+    }
+
+    if ((header.magic != CAPTURE_MAGIC) || (header.version != CAPTURE_VERSION))
+    {
+        printf("Not a capture file, or unsupported version\n");
+        goto cleanup;
+    }
+
+    fseek(f, header.header_size, SEEK_SET);
+
+    size_t pixels = (size_t)header.width * header.height;
+
+    frame = calloc(pixels, sizeof(uint16_t));
+    delta = malloc(pixels * sizeof(uint16_t));
+    rgb = malloc(pixels * 3);
+    name = malloc(strlen(argv[2]) + 32);
+    if ((frame == NULL) || (delta == NULL) || (rgb == NULL) || (name == NULL))
+    {
+        printf("Not enough memory\n");
+        goto cleanup;
+    }
+
+    if (argc == 4)
+    {
+        wav = fopen(argv[3], "wb");
+        if (wav == NULL)
+        {
+            printf("Can't open %s\n", argv[3]);
+            goto cleanup;
+        }
+
+        // Leave space for the header
+        Save_WAV_Header(wav, &header, 0);
+    }
+
+    uint32_t frames = 0;
+    int has_keyframe = 0;
+
+    while (1)
+    {
+        capture_chunk_t chunk;
+        if (fread(&chunk, sizeof(chunk), 1, f) != 1)
+            break;
+
+        if (chunk.size > data_capacity)
+        {
+            uint8_t *new_data = realloc(data, chunk.size);
+            if (new_data == NULL)
+            {
+                printf("Not enough memory\n");
+                goto cleanup;
+            }
+            data = new_data;
+            data_capacity = chunk.size;
+        }
+
+        if ((chunk.size > 0) && (fread(data, chunk.size, 1, f) != 1))
+        {
+            printf("Truncated chunk\n");
+            break;
+        }
+
+        if (chunk.id == CAPTURE_CHUNK_AUDIO)
+        {
+            if (wav != NULL)
+            {
+                if (fwrite(data, chunk.size, 1, wav) != 1)
+                {
+                    printf("Failed to write audio\n");
+                    goto cleanup;
+                }
+                audio_size += chunk.size;
+            }
+            continue;
+        }
+
+        if ((chunk.id != CAPTURE_CHUNK_KEY) &&
+            (chunk.id != CAPTURE_CHUNK_DELTA))
+        {
+            printf("Unknown chunk: 0x%08X\n", (unsigned int)chunk.id);
+            continue;
+        }
+
+        if (Decode_RLE((const uint16_t *)data, chunk.size / sizeof(uint16_t),
+                       delta, pixels) != 0)
+        {
+            printf("Corrupted frame: %u\n", (unsigned int)frames);
+            goto cleanup;
+        }
+
+        if (chunk.id == CAPTURE_CHUNK_KEY)
+        {
+            memcpy(frame, delta, pixels * sizeof(uint16_t));
+            has_keyframe = 1;
+        }
+        else
+        {
+            if (has_keyframe == 0)
+            {
+                printf("Delta frame without keyframe: %u\n",
+                       (unsigned int)frames);
+                goto cleanup;
+            }
+
+            for (size_t i = 0; i < pixels; i++)
+                frame[i] ^= delta[i];
+        }
+
+        sprintf(name, "%s%06u.png", argv[2], (unsigned int)frames);
+
+        if (Save_PNG(name, frame, header.width, header.height, rgb) != 0)
+            goto cleanup;
+
+        frames++;
+    }
+
+    if (frames != header.num_frames)
+    {
+        printf("Expected %u frames, found %u\n",
+               (unsigned int)header.num_frames, (unsigned int)frames);
+        goto cleanup;
+    }
+
+    printf("Frames: %u\n", (unsigned int)frames);
+
+    // Success
+    ret = 0;
+
+cleanup:
+
+    if (wav != NULL)
+    {
+        Save_WAV_Header(wav, &header, audio_size);
+        fclose(wav);
+    }
+
+    if (f != NULL)
+        fclose(f);
+
+    free(frame);
+    free(delta);
+    free(rgb);
+    free(data);
+    free(name);
+
+    return ret;
+}
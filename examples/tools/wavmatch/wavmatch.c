@@ -0,0 +1,484 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+// Compares two 16-bit PCM WAV files with a tolerance. The files are aligned
+// with a cross-correlation of their first second (in case one of them has been
+// delayed by a few samples) and then they are compared in a streaming way, so
+// the memory used doesn't depend on the size of the files.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_CHANNELS    (8)
+#define BLOCK_FRAMES    (4096)
+
+typedef struct {
+    FILE *f;
+    long data_start;     // Offset of the samples in the file
+    uint32_t data_size;  // Size of the samples in bytes
+    uint32_t data_left;  // Bytes left to read
+    int channels;
+    uint32_t sample_rate;
+} wav_reader_t;
+
+static uint32_t Read_U32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t Read_U16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static int WAV_Open(wav_reader_t *wav, const char *path)
+{
+    memset(wav, 0, sizeof(wav_reader_t));
+
+    wav->f = fopen(path, "rb");
+    if (wav->f == NULL)
+    {
+        printf("Can't open %s\n", path);
+        return 1;
+    }
+
+    uint8_t riff[12];
+    if ((fread(riff, sizeof(riff), 1, wav->f) != 1) ||
+        (memcmp(&riff[0], "RIFF", 4) != 0) ||
+        (memcmp(&riff[8], "WAVE", 4) != 0))
+    {
+        printf("%s: Not a WAV file\n", path);
+        return 1;
+    }
+
+    int has_format = 0;
+
+    // Look for the "fmt " and "data" chunks, skipping everything else
+    while (1)
+    {
+        uint8_t chunk[8];
+        if (fread(chunk, sizeof(chunk), 1, wav->f) != 1)
+        {
+            printf("%s: Data chunk not found\n", path);
+            return 1;
+        }
+
+        uint32_t size = Read_U32(&chunk[4]);
+
+        if (memcmp(chunk, "fmt ", 4) == 0)
+        {
+            uint8_t fmt[16];
+            if ((size < sizeof(fmt)) ||
+                (fread(fmt, sizeof(fmt), 1, wav->f) != 1))
+            {
+                printf("%s: Invalid format chunk\n", path);
+                return 1;
+            }
+
+            uint16_t format = Read_U16(&fmt[0]);
+            uint16_t bits = Read_U16(&fmt[14]);
+
+            wav->channels = Read_U16(&fmt[2]);
+            wav->sample_rate = Read_U32(&fmt[4]);
+
+            // PCM or WAVE_FORMAT_EXTENSIBLE
+            if (((format != 1) && (format != 0xFFFE)) || (bits != 16))
+            {
+                printf("%s: Only 16-bit PCM files are supported\n", path);
+                return 1;
+            }
+
+            if ((wav->channels < 1) || (wav->channels > MAX_CHANNELS))
+            {
+                printf("%s: Invalid number of channels: %d\n", path,
+                       wav->channels);
+                return 1;
+            }
+
+            has_format = 1;
+            size -= sizeof(fmt);
+        }
+        else if (memcmp(chunk, "data", 4) == 0)
+        {
+            if (has_format == 0)
+            {
+                printf("%s: Data chunk before format chunk\n", path);
+                return 1;
+            }
+
+            wav->data_start = ftell(wav->f);
+            wav->data_size = size;
+            wav->data_left = size;
+            return 0;
+        }
+
+        // Chunks are padded to an even size
+        if (fseek(wav->f, size + (size & 1), SEEK_CUR) != 0)
+        {
+            printf("%s: Data chunk not found\n", path);
+            return 1;
+        }
+    }
+}
+
+static void WAV_Close(wav_reader_t *wav)
+{
+    if (wav->f != NULL)
+        fclose(wav->f);
+    wav->f = NULL;
+}
+
+static uint32_t WAV_Frames(const wav_reader_t *wav)
+{
+    return wav->data_size / (wav->channels * sizeof(int16_t));
+}
+
+// Go back to the first sample and skip the specified number of frames
+static void WAV_Rewind(wav_reader_t *wav, uint32_t skip_frames)
+{
+    uint32_t skip = skip_frames * wav->channels * sizeof(int16_t);
+    if (skip > wav->data_size)
+        skip = wav->data_size;
+
+    fseek(wav->f, wav->data_start + skip, SEEK_SET);
+    wav->data_left = wav->data_size - skip;
+}
+
+// Returns the number of frames read
+static uint32_t WAV_Read(wav_reader_t *wav, int16_t *buffer, uint32_t frames)
+{
+    uint32_t frame_size = wav->channels * sizeof(int16_t);
+    uint32_t available = wav->data_left / frame_size;
+
+    if (frames > available)
+        frames = available;
+
+    if (frames == 0)
+        return 0;
+
+    uint8_t *raw = (uint8_t *)buffer;
+    size_t read = fread(raw, frame_size, frames, wav->f);
+
+    // Convert from little endian
+    for (size_t i = 0; i < read * wav->channels; i++)
+        buffer[i] = (int16_t)Read_U16(&raw[i * 2]);
+
+    wav->data_left -= read * frame_size;
+
+    return read;
+}
+
+// Find the delay of the test file relative to the reference file that gives
+// the highest normalized cross-correlation between the first window_frames of
+// both files. A positive result means that the test file is delayed.
+static int32_t Find_Offset(wav_reader_t *ref, wav_reader_t *test,
+                           uint32_t window_frames, uint32_t max_offset)
+{
+    if (max_offset == 0)
+        return 0;
+
+    uint32_t size = window_frames + max_offset;
+    double *a = calloc(size, sizeof(double));
+    double *b = calloc(size, sizeof(double));
+    int16_t *block = malloc(BLOCK_FRAMES * MAX_CHANNELS * sizeof(int16_t));
+
+    int32_t best_offset = 0;
+
+    if ((a == NULL) || (b == NULL) || (block == NULL))
+    {
+        printf("Not enough memory to align files\n");
+        goto cleanup;
+    }
+
+    // Mix all channels so that the alignment is done only once
+
+    wav_reader_t *wavs[2] = { ref, test };
+    double *dst[2] = { a, b };
+
+    for (int w = 0; w < 2; w++)
+    {
+        WAV_Rewind(wavs[w], 0);
+
+        uint32_t done = 0;
+        while (done < size)
+        {
+            uint32_t want = size - done;
+            if (want > BLOCK_FRAMES)
+                want = BLOCK_FRAMES;
+
+            uint32_t got = WAV_Read(wavs[w], block, want);
+            if (got == 0)
+                break;
+
+            for (uint32_t i = 0; i < got; i++)
+            {
+                double sum = 0;
+                for (int c = 0; c < wavs[w]->channels; c++)
+                    sum += block[i * wavs[w]->channels + c];
+                dst[w][done + i] = sum;
+            }
+
+            done += got;
+        }
+    }
+
+    double best = -2.0;
+
+    for (int32_t offset = -(int32_t)max_offset; offset <= (int32_t)max_offset;
+         offset++)
+    {
+        // Compare a[i] with b[i + offset] for i in [skip, skip + window)
+        uint32_t skip = (offset < 0) ? -offset : 0;
+
+        double ab = 0, aa = 0, bb = 0;
+        for (uint32_t i = skip; i < skip + window_frames; i++)
+        {
+            double x = a[i];
+            double y = b[i + offset];
+            ab += x * y;
+            aa += x * x;
+            bb += y * y;
+        }
+
+        // Silence matches anything. Leave the offset as it is.
+        if ((aa <= 0) || (bb <= 0))
+            continue;
+
+        double corr = ab / sqrt(aa * bb);
+        if (corr > best)
+        {
+            best = corr;
+            best_offset = offset;
+        }
+    }
+
+cleanup:
+    free(a);
+    free(b);
+    free(block);
+
+    return best_offset;
+}
+
+static void Usage(const char *name)
+{
+    printf("Usage: %s reference.wav test.wav [options]\n"
+           "\n"
+           "Options:\n"
+           "  --max-rms N     Max RMS error allowed (default: 0)\n"
+           "  --max-peak N    Max absolute error of a sample (default: 0)\n"
+           "  --max-offset N  Max delay between files in frames (default: 0)\n"
+           "  --profile       Print the error of each second\n"
+           "\n"
+           "Errors are measured in 16-bit sample units.\n"
+           "Return: 0 if the files match, 1 if they don't, 2 on error.\n",
+           name);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    double max_rms = 0.0;
+    long max_peak = 0;
+    long max_offset = 0;
+    int profile = 0;
+
+    for (int i = 3; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "--max-rms") == 0) && (i + 1 < argc))
+        {
+            max_rms = atof(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--max-peak") == 0) && (i + 1 < argc))
+        {
+            max_peak = atol(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--max-offset") == 0) && (i + 1 < argc))
+        {
+            max_offset = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--profile") == 0)
+        {
+            profile = 1;
+        }
+        else
+        {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (max_offset < 0)
+        max_offset = 0;
+
+    int ret = 2;
+
+    wav_reader_t ref = { 0 }, test = { 0 };
+
+    if ((WAV_Open(&ref, argv[1]) != 0) || (WAV_Open(&test, argv[2]) != 0))
+        goto cleanup;
+
+    if ((ref.channels != test.channels) ||
+        (ref.sample_rate != test.sample_rate))
+    {
+        printf("Formats are different: %d ch %u Hz vs %d ch %u Hz\n",
+               ref.channels, (unsigned int)ref.sample_rate,
+               test.channels, (unsigned int)test.sample_rate);
+        ret = 1;
+        goto cleanup;
+    }
+
+    int channels = ref.channels;
+    uint32_t rate = ref.sample_rate;
+
+    // Align the files using the first second of audio
+
+    uint32_t window = rate;
+    uint32_t ref_frames = WAV_Frames(&ref);
+    uint32_t test_frames = WAV_Frames(&test);
+    uint32_t shortest = ref_frames < test_frames ? ref_frames : test_frames;
+
+    if ((uint32_t)max_offset >= shortest)
+        max_offset = shortest > 0 ? shortest - 1 : 0;
+    if (window + max_offset > shortest)
+        window = shortest - max_offset;
+
+    int32_t offset = Find_Offset(&ref, &test, window, max_offset);
+
+    WAV_Rewind(&ref, offset < 0 ? -offset : 0);
+    WAV_Rewind(&test, offset > 0 ? offset : 0);
+
+    // Compare the files
+
+    static int16_t block_ref[BLOCK_FRAMES * MAX_CHANNELS];
+    static int16_t block_test[BLOCK_FRAMES * MAX_CHANNELS];
+
+    double total_sq = 0.0;
+    double total_ref_sq = 0.0;
+    uint64_t total_samples = 0;
+    long total_peak = 0;
+    uint64_t peak_frame = 0;
+
+    double second_sq = 0.0;
+    long second_peak = 0;
+    uint32_t second_frames = 0;
+    uint32_t second = 0;
+
+    if (profile)
+        printf("Second  RMS error  Peak error\n");
+
+    while (1)
+    {
+        uint32_t got_ref = WAV_Read(&ref, block_ref, BLOCK_FRAMES);
+        uint32_t got_test = WAV_Read(&test, block_test, BLOCK_FRAMES);
+
+        // Both files advance at the same rate, so this only happens at the end
+        uint32_t frames = got_ref < got_test ? got_ref : got_test;
+        if (frames == 0)
+            break;
+
+        for (uint32_t i = 0; i < frames; i++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                int32_t r = block_ref[i * channels + c];
+                int32_t e = block_test[i * channels + c] - r;
+                long ae = labs(e);
+
+                second_sq += (double)e * e;
+                total_ref_sq += (double)r * r;
+
+                if (ae > second_peak)
+                    second_peak = ae;
+
+                if (ae > total_peak)
+                {
+                    total_peak = ae;
+                    peak_frame = total_samples / channels;
+                }
+
+                total_samples++;
+            }
+
+            second_frames++;
+
+            if (second_frames == rate)
+            {
+                if (profile)
+                {
+                    printf("%6u  %9.3f  %10ld\n", (unsigned int)second,
+                           sqrt(second_sq / (second_frames * channels)),
+                           second_peak);
+                }
+
+                total_sq += second_sq;
+                second_sq = 0.0;
+                second_peak = 0;
+                second_frames = 0;
+                second++;
+            }
+        }
+    }
+
+    if ((second_frames > 0) && profile)
+    {
+        printf("%6u  %9.3f  %10ld\n", (unsigned int)second,
+               sqrt(second_sq / (second_frames * channels)), second_peak);
+    }
+
+    total_sq += second_sq;
+
+    double rms = 0.0;
+    if (total_samples > 0)
+        rms = sqrt(total_sq / total_samples);
+
+    printf("Frames: %u / %u\n", (unsigned int)ref_frames,
+           (unsigned int)test_frames);
+    printf("Offset: %d frames\n", (int)offset);
+    printf("RMS error: %.3f\n", rms);
+    printf("Peak error: %ld (frame %llu)\n", total_peak,
+           (unsigned long long)peak_frame);
+
+    if ((total_sq > 0.0) && (total_ref_sq > 0.0))
+        printf("SNR: %.2f dB\n", 10.0 * log10(total_ref_sq / total_sq));
+
+    ret = 0;
+
+    // After the alignment, the files must have the same length
+    uint32_t compared = total_samples / channels;
+    uint32_t ref_left = ref_frames - (offset < 0 ? -offset : 0) - compared;
+    uint32_t test_left = test_frames - (offset > 0 ? offset : 0) - compared;
+    if ((ref_left > (uint32_t)max_offset) || (test_left > (uint32_t)max_offset))
+    {
+        printf("Lengths are different\n");
+        ret = 1;
+    }
+
+    if (rms > max_rms)
+    {
+        printf("RMS error over the limit: %.3f > %.3f\n", rms, max_rms);
+        ret = 1;
+    }
+
+    if (total_peak > max_peak)
+    {
+        printf("Peak error over the limit: %ld > %ld\n", total_peak, max_peak);
+        ret = 1;
+    }
+
+cleanup:
+
+    WAV_Close(&ref);
+    WAV_Close(&test);
+
+    return ret;
+}
@@ -25,14 +25,37 @@ function(add_data_file source_file destination_target)
 
     set(OUT_FILES ${OUT_C_FILE} ${OUT_H_FILE})
 
-    # Create rule that depends on the DATA and GRIT file
-
-    add_custom_command(
-        OUTPUT ${OUT_FILES}
-        COMMAND $<TARGET_FILE:bin2c> ${DATA_FILE} ${OUT_DIR}
-        DEPENDS ${DATA_FILE}
-        WORKING_DIRECTORY ${OUT_DIR}
-    )
+    # Files with extension .lz77, .lz77vram, .rle, .huff4 or .huff8 are
+    # compressed with gbacomp before converting them. The compressed file keeps
+    # the same name so that the name of the array doesn't change.
+
+    get_filename_component(DATA_EXT ${DATA_FILE} LAST_EXT)
+    string(TOLOWER "${DATA_EXT}" DATA_EXT)
+
+    set(GBACOMP_EXTENSIONS .lz77 .lz77vram .rle .huff4 .huff8)
+
+    # Create rule that depends on the DATA file
+
+    if(DATA_EXT IN_LIST GBACOMP_EXTENSIONS)
+        string(SUBSTRING ${DATA_EXT} 1 -1 GBACOMP_MODE)
+        set(COMPRESSED_FILE "${OUT_DIR}/${DATA_NAME_RAW}")
+
+        add_custom_command(
+            OUTPUT ${OUT_FILES}
+            COMMAND $<TARGET_FILE:gbacomp> ${GBACOMP_MODE} ${DATA_FILE}
+                                           ${COMPRESSED_FILE}
+            COMMAND $<TARGET_FILE:bin2c> ${COMPRESSED_FILE} ${OUT_DIR}
+            DEPENDS ${DATA_FILE}
+            WORKING_DIRECTORY ${OUT_DIR}
+        )
+    else()
+        add_custom_command(
+            OUTPUT ${OUT_FILES}
+            COMMAND $<TARGET_FILE:bin2c> ${DATA_FILE} ${OUT_DIR}
+            DEPENDS ${DATA_FILE}
+            WORKING_DIRECTORY ${OUT_DIR}
+        )
+    endif()
 
     # Add output source files to the target
 
@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: MIT
 //
-// Copyright (c) 2020 Antonio Niño Díaz
+// Copyright (c) 2020-2021 Antonio Niño Díaz
 
 #ifndef BIOS_H__
 #define BIOS_H__
@@ -52,6 +52,10 @@ EXPORT_API void SWI_CpuFastSet(const void *src, void *dst, uint32_t len_mode);
 EXPORT_API int32_t SWI_Div(int32_t num, int32_t div);
 EXPORT_API int32_t SWI_DivMod(int32_t num, int32_t div);
 
+// Calculate both the result and the modulus of dividing num by div with only
+// one division. The modulus is returned in mod, which can't be NULL.
+EXPORT_API int32_t SWI_DivAndMod(int32_t num, int32_t div, int32_t *mod);
+
 // Calculate square root.
 EXPORT_API uint16_t SWI_Sqrt(uint32_t value);
 
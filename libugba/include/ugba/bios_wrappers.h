@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: MIT
 //
-// Copyright (c) 2020 Antonio Niño Díaz
+// Copyright (c) 2020-2021 Antonio Niño Díaz
 
 #ifndef BIOS_WRAPPERS_H__
 #define BIOS_WRAPPERS_H__
@@ -36,4 +36,11 @@ EXPORT_API void SWI_CpuFastSet_Fill32(const void *src, void *dst, size_t len);
 EXPORT_API void SWI_ObjAffineSet_OAM(const obj_affine_src *src,
                                      oam_matrix_entry *dst, uint32_t count);
 
+// Fills the affine registers of one or two backgrounds from an array of
+// transformations. The index of the first background must be 2 or 3, and the
+// values are written to the registers of consecutive backgrounds. It returns 0
+// on success, or -1 if the backgrounds don't have affine registers.
+EXPORT_API int SWI_BgAffineSet_Regs(const bg_affine_src *src, int index,
+                                    uint32_t count);
+
 #endif // BIOS_WRAPPERS_H__
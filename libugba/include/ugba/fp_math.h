@@ -1,10 +1,13 @@
 // SPDX-License-Identifier: MIT
 //
-// Copyright (c) 2020 Antonio Niño Díaz
+// Copyright (c) 2020-2021 Antonio Niño Díaz
 
 #ifndef FP_MATH_H__
 #define FP_MATH_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "definitions.h"
 
 #define FP_PI       (0x8000)
@@ -16,4 +19,18 @@
 EXPORT_API IWRAM_CODE int32_t FP_Sin(int32_t x);
 EXPORT_API IWRAM_CODE int32_t FP_Cos(int32_t x);
 
+// Calculates the sine and cosine of an angle at the same time.
+EXPORT_API IWRAM_CODE void FP_SinCos(int32_t x, int32_t *sine,
+                                     int32_t *cosine);
+
+// Calculates the sines and cosines of an array of angles. Either sine or cosine
+// can be NULL if only the other one is needed.
+EXPORT_API IWRAM_CODE void FP_SinCosArray(const int32_t *x, int32_t *sine,
+                                          int32_t *cosine, size_t count);
+
+// Note: By default, the results are calculated with a polynomial. If libugba is
+// built with ENABLE_FP_TRIG_LUT, they are interpolated from a lookup table,
+// which is faster. The maximum error is similar in both cases, but the results
+// aren't exactly the same.
+
 #endif // FP_MATH_H__
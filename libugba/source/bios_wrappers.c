@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: MIT
 //
-// Copyright (c) 2020 Antonio Niño Díaz
+// Copyright (c) 2020-2021 Antonio Niño Díaz
 
 #include <ugba/ugba.h>
 
@@ -43,3 +43,32 @@ void SWI_ObjAffineSet_OAM(const obj_affine_src *src, oam_matrix_entry *dst,
     SWI_ObjAffineSet(src, (void *)real_dst, count, 8);
 }
 
+int SWI_BgAffineSet_Regs(const bg_affine_src *src, int index, uint32_t count)
+{
+    // Only BG2 and BG3 have affine registers. Anything else would write to the
+    // registers after the ones of BG3.
+    UMOD_Assert((index >= 2) && (count <= 2) && (index + count <= 4));
+
+    // If asserts are disabled, return an error code at least.
+    if ((index < 2) || (count > 2) || (index + count > 4))
+        return -1;
+
+    // The affine registers of each background have the same layout as
+    // bg_affine_dst, and the ones of BG3 are right after the ones of BG2.
+    uintptr_t base = (uintptr_t)PTR_REG_16(OFFSET_BG2PA);
+    bg_affine_dst *dst = (bg_affine_dst *)base + (index - 2);
+
+    SWI_BgAffineSet(src, dst, count);
+
+    // Writing to the reference point registers resets the internal reference
+    // point used by the hardware.
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t offset = (index - 2 + i) * sizeof(bg_affine_dst);
+
+        UGBA_RegisterUpdatedOffset(OFFSET_BG2X_L + offset);
+        UGBA_RegisterUpdatedOffset(OFFSET_BG2Y_L + offset);
+    }
+
+    return 0;
+}
@@ -1,9 +1,95 @@
 // SPDX-License-Identifier: MIT
 //
-// Copyright (c) 2020 Antonio Niño Díaz
+// Copyright (c) 2020-2021 Antonio Niño Díaz
 
 #include <ugba/ugba.h>
 
+#if defined(UGBA_FP_TRIG_LUT)
+
+// Quarter of a sine wave, from 0 to pi/2 (both included) in 64 steps. The last
+// entry is repeated so that the interpolation never reads outside of the table.
+// The maximum error of the interpolated values is 6 (out of 65536).
+
+#define FP_SIN_LUT_SHIFT    (8) // 0x4000 / 64 = 1 << 8
+
+static IWRAM_DATA int32_t fp_sin_lut[64 + 2] = {
+    0, 1608, 3216, 4821, 6424, 8022, 9616, 11204,
+    12785, 14359, 15924, 17479, 19024, 20557, 22078, 23586,
+    25080, 26558, 28020, 29466, 30893, 32303, 33692, 35062,
+    36410, 37736, 39040, 40320, 41576, 42806, 44011, 45190,
+    46341, 47464, 48559, 49624, 50660, 51665, 52639, 53581,
+    54491, 55368, 56212, 57022, 57798, 58538, 59244, 59914,
+    60547, 61145, 61705, 62228, 62714, 63162, 63572, 63944,
+    64277, 64571, 64827, 65043, 65220, 65358, 65457, 65516,
+    65536, 65536,
+};
+
+// Input: 0 to FP_PI_2, both included
+static ARM_CODE IWRAM_CODE int32_t FP_SinQuadrant(uint32_t x)
+{
+    uint32_t index = x >> FP_SIN_LUT_SHIFT;
+    int32_t frac = x & ((1 << FP_SIN_LUT_SHIFT) - 1);
+
+    int32_t a = fp_sin_lut[index];
+    int32_t b = fp_sin_lut[index + 1];
+
+    return a + (((b - a) * frac + (1 << (FP_SIN_LUT_SHIFT - 1)))
+                >> FP_SIN_LUT_SHIFT);
+}
+
+// Input: A full cirle is 0x10000 (PI = 0x8000)
+// Output: Between 1 << 16 and -1 << 16 (1.0 to -1.0)
+ARM_CODE IWRAM_CODE int32_t FP_Sin(int32_t x)
+{
+    uint32_t angle = x & (FP_2_PI - 1);
+    uint32_t r = angle & (FP_PI_2 - 1);
+
+    switch (angle >> 14)
+    {
+        case 0:
+            return FP_SinQuadrant(r);
+        case 1:
+            return FP_SinQuadrant(FP_PI_2 - r);
+        case 2:
+            return -FP_SinQuadrant(r);
+        default:
+            return -FP_SinQuadrant(FP_PI_2 - r);
+    }
+}
+
+ARM_CODE IWRAM_CODE void FP_SinCos(int32_t x, int32_t *sine,
+                                   int32_t *cosine)
+{
+    uint32_t angle = x & (FP_2_PI - 1);
+    uint32_t r = angle & (FP_PI_2 - 1);
+
+    // Sine and cosine of the angle inside the quadrant
+    int32_t s = FP_SinQuadrant(r);
+    int32_t c = FP_SinQuadrant(FP_PI_2 - r);
+
+    switch (angle >> 14)
+    {
+        case 0:
+            *sine = s;
+            *cosine = c;
+            break;
+        case 1:
+            *sine = c;
+            *cosine = -s;
+            break;
+        case 2:
+            *sine = -s;
+            *cosine = -c;
+            break;
+        default:
+            *sine = -c;
+            *cosine = s;
+            break;
+    }
+}
+
+#else // UGBA_FP_TRIG_LUT
+
 // Input: A full cirle is 0x10000 (PI = 0x8000)
 // Output: Between 1 << 16 and -1 << 16 (1.0 to -1.0)
 ARM_CODE IWRAM_CODE int32_t FP_Sin(int32_t x)
@@ -107,7 +193,39 @@ ARM_CODE IWRAM_CODE int32_t FP_Sin(int32_t x)
     return result;
 }
 
+ARM_CODE IWRAM_CODE void FP_SinCos(int32_t x, int32_t *sine,
+                                   int32_t *cosine)
+{
+    *sine = FP_Sin(x);
+    *cosine = FP_Sin(x + FP_PI_2);
+}
+
+#endif // UGBA_FP_TRIG_LUT
+
 ARM_CODE IWRAM_CODE int32_t FP_Cos(int32_t x)
 {
     return FP_Sin(x + FP_PI_2);
 }
+
+ARM_CODE IWRAM_CODE void FP_SinCosArray(const int32_t *x, int32_t *sine,
+                                        int32_t *cosine, size_t count)
+{
+    if ((sine == NULL) && (cosine == NULL))
+        return;
+
+    if (sine == NULL)
+    {
+        for (size_t i = 0; i < count; i++)
+            cosine[i] = FP_Cos(x[i]);
+    }
+    else if (cosine == NULL)
+    {
+        for (size_t i = 0; i < count; i++)
+            sine[i] = FP_Sin(x[i]);
+    }
+    else
+    {
+        for (size_t i = 0; i < count; i++)
+            FP_SinCos(x[i], &sine[i], &cosine[i]);
+    }
+}
@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: MIT
 //
-// Copyright (c) 2020 Antonio Niño Díaz
+// Copyright (c) 2020-2021 Antonio Niño Díaz
 
 #include <ugba/ugba.h>
 
@@ -100,6 +100,30 @@ int32_t SWI_DivMod(int32_t num, int32_t div)
     return result;
 }
 
+int32_t SWI_DivAndMod(int32_t num, int32_t div, int32_t *mod)
+{
+    if (div == 0)
+    {
+        *mod = 0;
+        return 0;
+    }
+
+    register int32_t num_ asm("r0") = num;
+    register int32_t div_ asm("r1") = div;
+    register int32_t result asm("r0");
+    register int32_t remainder asm("r1");
+
+    asm volatile(
+        SWI_NUMBER(0x06) :
+        "=r"(result), "=r"(remainder) :
+        "r"(num_), "r"(div_) :
+        "r2", "r3", "memory"
+    );
+
+    *mod = remainder;
+    return result;
+}
+
 uint16_t SWI_Sqrt(uint32_t value)
 {
     register uint32_t value_ asm("r0") = value;
@@ -0,0 +1,334 @@
+// SPDX-License-Identifier: LGPL-3.0-only
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#include "capture_io.h"
+#include "debug_utils.h"
+
+#define CAPTURE_BUFFER_COUNT    (8)
+#define CAPTURE_BUFFER_SIZE     (256 * 1024)
+
+struct capture_file {
+    FILE *file;
+    char *path;
+
+    SDL_Thread *thread;
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+
+    uint8_t *buffers[CAPTURE_BUFFER_COUNT];
+    size_t used[CAPTURE_BUFFER_COUNT];
+
+    // Buffers waiting to be written, in order
+    int queue[CAPTURE_BUFFER_COUNT];
+    int queue_head;
+    int queue_count;
+
+    // Buffers that can be filled
+    int free_list[CAPTURE_BUFFER_COUNT];
+    int free_count;
+
+    int writing; // 1 while the thread is writing a buffer
+    int blocking;
+    int quit;
+    int error;
+
+    // Only used by the thread that calls CaptureIO_Write()
+    int current; // Buffer being filled, or -1
+    int dropping; // 1 if the last write was dropped
+
+    capture_stats stats;
+};
+
+static int CaptureIO_Thread(void *data)
+{
+    capture_file *cf = data;
+
+    SDL_LockMutex(cf->mutex);
+
+    while (1)
+    {
+        while ((cf->queue_count == 0) && (cf->quit == 0))
+            SDL_CondWait(cf->cond, cf->mutex);
+
+        if (cf->queue_count == 0)
+            break;
+
+        int index = cf->queue[cf->queue_head];
+        cf->queue_head = (cf->queue_head + 1) % CAPTURE_BUFFER_COUNT;
+        cf->queue_count--;
+        cf->writing = 1;
+
+        SDL_UnlockMutex(cf->mutex);
+
+        // The buffer isn't accessed by anyone else until it is freed
+        size_t size = cf->used[index];
+        int ok = 1;
+        if (size > 0)
+            ok = fwrite(cf->buffers[index], size, 1, cf->file) == 1;
+
+        SDL_LockMutex(cf->mutex);
+
+        if (ok)
+            cf->stats.bytes_written += size;
+        else
+            cf->error = 1;
+
+        cf->used[index] = 0;
+        cf->free_list[cf->free_count++] = index;
+        cf->writing = 0;
+
+        // Wake up anyone waiting for the queue to be drained
+        SDL_CondBroadcast(cf->cond);
+    }
+
+    SDL_UnlockMutex(cf->mutex);
+
+    return 0;
+}
+
+static void CaptureIO_Free(capture_file *cf)
+{
+    for (int i = 0; i < CAPTURE_BUFFER_COUNT; i++)
+        free(cf->buffers[i]);
+
+    if (cf->cond)
+        SDL_DestroyCond(cf->cond);
+    if (cf->mutex)
+        SDL_DestroyMutex(cf->mutex);
+
+    free(cf->path);
+    free(cf);
+}
+
+capture_file *CaptureIO_Open(const char *path, size_t header_size)
+{
+    capture_file *cf = calloc(1, sizeof(capture_file));
+    if (cf == NULL)
+    {
+        Debug_Log("%s(): Not enough memory", __func__);
+        return NULL;
+    }
+
+    cf->current = -1;
+
+    for (int i = 0; i < CAPTURE_BUFFER_COUNT; i++)
+    {
+        cf->buffers[i] = malloc(CAPTURE_BUFFER_SIZE);
+        if (cf->buffers[i] == NULL)
+        {
+            Debug_Log("%s(): Not enough memory", __func__);
+            CaptureIO_Free(cf);
+            return NULL;
+        }
+
+        cf->free_list[i] = i;
+    }
+    cf->free_count = CAPTURE_BUFFER_COUNT;
+
+    cf->path = malloc(strlen(path) + 1);
+    if (cf->path == NULL)
+    {
+        Debug_Log("%s(): Not enough memory", __func__);
+        CaptureIO_Free(cf);
+        return NULL;
+    }
+    strcpy(cf->path, path);
+
+    cf->file = fopen(path, "wb");
+    if (cf->file == NULL)
+    {
+        Debug_Log("%s(): Can't open file for writing: %s", __func__, path);
+        CaptureIO_Free(cf);
+        return NULL;
+    }
+
+    // Leave space for the header
+    for (size_t i = 0; i < header_size; i++)
+    {
+        if (fputc(0, cf->file) == EOF)
+        {
+            Debug_Log("%s(): Can't allocate space for header: %s", __func__,
+                      path);
+            fclose(cf->file);
+            CaptureIO_Free(cf);
+            return NULL;
+        }
+    }
+
+    cf->mutex = SDL_CreateMutex();
+    cf->cond = SDL_CreateCond();
+    if ((cf->mutex == NULL) || (cf->cond == NULL))
+    {
+        Debug_Log("%s(): Can't create mutex: %s", __func__, SDL_GetError());
+        fclose(cf->file);
+        CaptureIO_Free(cf);
+        return NULL;
+    }
+
+    cf->thread = SDL_CreateThread(CaptureIO_Thread, "Capture writer", cf);
+    if (cf->thread == NULL)
+    {
+        Debug_Log("%s(): Can't create thread: %s", __func__, SDL_GetError());
+        fclose(cf->file);
+        CaptureIO_Free(cf);
+        return NULL;
+    }
+
+    return cf;
+}
+
+// Send the buffer being filled to the writer thread
+static void CaptureIO_Submit(capture_file *cf)
+{
+    if (cf->current == -1)
+        return;
+
+    SDL_LockMutex(cf->mutex);
+
+    int tail = (cf->queue_head + cf->queue_count) % CAPTURE_BUFFER_COUNT;
+    cf->queue[tail] = cf->current;
+    cf->queue_count++;
+
+    if (cf->queue_count > cf->stats.max_backlog)
+        cf->stats.max_backlog = cf->queue_count;
+
+    SDL_CondBroadcast(cf->cond);
+
+    SDL_UnlockMutex(cf->mutex);
+
+    cf->current = -1;
+}
+
+void CaptureIO_SetBlocking(capture_file *cf, int blocking)
+{
+    SDL_LockMutex(cf->mutex);
+    cf->blocking = blocking;
+    SDL_UnlockMutex(cf->mutex);
+}
+
+int CaptureIO_Write(capture_file *cf, const void *data, size_t size)
+{
+    const uint8_t *src = data;
+
+    while (size > 0)
+    {
+        if (cf->current == -1)
+        {
+            SDL_LockMutex(cf->mutex);
+
+            if (cf->blocking)
+            {
+                while (cf->free_count == 0)
+                    SDL_CondWait(cf->cond, cf->mutex);
+            }
+
+            if (cf->free_count > 0)
+                cf->current = cf->free_list[--cf->free_count];
+            else
+                cf->stats.bytes_dropped += size;
+
+            SDL_UnlockMutex(cf->mutex);
+
+            if (cf->current == -1)
+            {
+                // Only report the start of each period of dropped data
+                if (cf->dropping == 0)
+                {
+                    Debug_Log("%s(): Writer is too slow, dropping data: %s",
+                              __func__, cf->path);
+                    cf->dropping = 1;
+                }
+                return 1;
+            }
+
+            cf->dropping = 0;
+        }
+
+        size_t used = cf->used[cf->current];
+        size_t copy = CAPTURE_BUFFER_SIZE - used;
+        if (copy > size)
+            copy = size;
+
+        memcpy(cf->buffers[cf->current] + used, src, copy);
+        cf->used[cf->current] = used + copy;
+
+        src += copy;
+        size -= copy;
+
+        if (cf->used[cf->current] == CAPTURE_BUFFER_SIZE)
+            CaptureIO_Submit(cf);
+    }
+
+    return 0;
+}
+
+uint64_t CaptureIO_Drain(capture_file *cf)
+{
+    CaptureIO_Submit(cf);
+
+    SDL_LockMutex(cf->mutex);
+
+    while ((cf->queue_count > 0) || cf->writing)
+        SDL_CondWait(cf->cond, cf->mutex);
+
+    uint64_t written = cf->stats.bytes_written;
+
+    SDL_UnlockMutex(cf->mutex);
+
+    return written;
+}
+
+int CaptureIO_Close(capture_file *cf, const void *header, size_t header_size)
+{
+    CaptureIO_Drain(cf);
+
+    SDL_LockMutex(cf->mutex);
+    cf->quit = 1;
+    SDL_CondBroadcast(cf->cond);
+    SDL_UnlockMutex(cf->mutex);
+
+    SDL_WaitThread(cf->thread, NULL);
+
+    int ret = cf->error;
+
+    if (header != NULL)
+    {
+        fseek(cf->file, 0, SEEK_SET);
+
+        if (fwrite(header, header_size, 1, cf->file) != 1)
+        {
+            Debug_Log("%s(): Can't write header: %s", __func__, cf->path);
+            ret = 1;
+        }
+    }
+
+    if (fclose(cf->file) != 0)
+        ret = 1;
+
+    if (cf->error)
+        Debug_Log("%s(): Failed to write data: %s", __func__, cf->path);
+
+    Debug_Log("%s: %s: Written %llu bytes, dropped %llu bytes, max backlog %d",
+              __func__, cf->path,
+              (unsigned long long)cf->stats.bytes_written,
+              (unsigned long long)cf->stats.bytes_dropped,
+              cf->stats.max_backlog);
+
+    CaptureIO_Free(cf);
+
+    return ret;
+}
+
+void CaptureIO_GetStats(capture_file *cf, capture_stats *stats)
+{
+    SDL_LockMutex(cf->mutex);
+    *stats = cf->stats;
+    SDL_UnlockMutex(cf->mutex);
+}
@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: LGPL-3.0-only
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+#ifndef SDL2_CAPTURE_IO_H__
+#define SDL2_CAPTURE_IO_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Files written by a background thread. The data passed to CaptureIO_Write()
+// is copied to one of a fixed number of preallocated buffers, and the buffers
+// are written to the file by a dedicated thread when they are full. The caller
+// never waits for the disk: if all buffers are waiting to be written, the new
+// data is dropped and counted in the statistics, unless the file is in blocking
+// mode.
+
+typedef struct capture_file capture_file;
+
+typedef struct {
+    uint64_t bytes_written;
+    uint64_t bytes_dropped;
+    int max_backlog; // Max number of full buffers waiting to be written
+} capture_stats;
+
+// Open a file and leave header_size bytes at the start of it for a header that
+// is written when the file is closed. Returns NULL on error.
+capture_file *CaptureIO_Open(const char *path, size_t header_size);
+
+// In blocking mode, CaptureIO_Write() waits for the writer thread instead of
+// dropping data. This is meant for writers that can't lose any data and that
+// already run in their own thread. It is disabled by default.
+void CaptureIO_SetBlocking(capture_file *cf, int blocking);
+
+// Returns 0 if all the data has been queued, 1 if some of it was dropped
+int CaptureIO_Write(capture_file *cf, const void *data, size_t size);
+
+// Wait until all the data queued so far has been written. Returns the number of
+// bytes written after the header.
+uint64_t CaptureIO_Drain(capture_file *cf);
+
+// Write all pending data, write the header at the start of the file (if header
+// isn't NULL) and close the file. It prints a summary of the statistics to the
+// log. Returns 0 on success.
+int CaptureIO_Close(capture_file *cf, const void *header, size_t header_size);
+
+void CaptureIO_GetStats(capture_file *cf, capture_stats *stats);
+
+#endif // SDL2_CAPTURE_IO_H__
@@ -0,0 +1,418 @@
+// SPDX-License-Identifier: LGPL-3.0-only
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#include "capture_io.h"
+#include "capture_utils.h"
+#include "debug_utils.h"
+#include "sound_utils.h"
+
+#include "core/sound.h"
+#include "core/video.h"
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t magic;             // "UGBC" == 0x43424755
+    uint16_t version;           // CAPTURE_VERSION
+    uint16_t header_size;       // Size of this header
+    uint16_t width;             // 240
+    uint16_t height;            // 160
+    uint32_t clocks_per_second; // The frame rate is clocks_per_second /
+    uint32_t clocks_per_frame;  // clocks_per_frame
+    uint32_t sample_rate;       // Sample rate of the audio
+    uint16_t num_channels;      // 2
+    uint16_t bits_per_sample;   // 16
+    uint32_t keyframe_interval; // Max number of frames between keyframes
+    uint32_t num_frames;        // Number of video frames in the file
+    uint32_t num_samples;       // Number of stereo samples in the file
+} capture_header_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t size;
+} capture_chunk_t;
+#pragma pack(pop)
+
+#define CAPTURE_MAGIC           (0x43424755)
+#define CAPTURE_VERSION         (1)
+
+#define CAPTURE_CHUNK_KEY       (0x59454B46) // "FKEY"
+#define CAPTURE_CHUNK_DELTA     (0x544C4446) // "FDLT"
+#define CAPTURE_CHUNK_AUDIO     (0x50445541) // "AUDP"
+
+#define CAPTURE_WIDTH           (240)
+#define CAPTURE_HEIGHT          (160)
+#define CAPTURE_PIXELS          (CAPTURE_WIDTH * CAPTURE_HEIGHT)
+
+#define GBA_CLOCKS_PER_SECOND   (16 * 1024 * 1024)
+#define GBA_CLOCKS_PER_FRAME    (228 * 1232)
+
+// Force a keyframe every 10 seconds so that a damaged file can be recovered
+#define CAPTURE_KEYFRAME_INTERVAL   (600)
+
+// Number of frames that can wait to be compressed. When it is full, the game
+// thread waits for the encoder thread.
+#define CAPTURE_QUEUE_FRAMES    (32)
+
+// Max number of stereo samples per frame. It is a lot bigger than the number of
+// samples generated by a frame (around 550).
+#define CAPTURE_MAX_SAMPLES     (2048)
+
+typedef struct {
+    uint16_t pixels[CAPTURE_PIXELS];
+    int16_t audio[CAPTURE_MAX_SAMPLES * 2];
+    uint32_t num_samples;
+} capture_frame_t;
+
+static capture_file *capture_file_handle;
+
+static SDL_Thread *capture_thread;
+static SDL_mutex *capture_mutex;
+static SDL_cond *capture_cond;
+
+static capture_frame_t *capture_frames; // CAPTURE_QUEUE_FRAMES elements
+static int capture_queue_head;
+static int capture_queue_count;
+static int capture_quit;
+
+// Only used by the game thread
+static int16_t capture_audio[CAPTURE_MAX_SAMPLES * 2];
+static uint32_t capture_audio_samples;
+static uint32_t capture_stalls;
+static int capture_max_queued;
+
+// Only used by the encoder thread
+static uint16_t capture_prev_frame[CAPTURE_PIXELS];
+static uint16_t capture_delta[CAPTURE_PIXELS];
+// Worst case of the RLE compression, plus some margin
+static uint16_t capture_rle[CAPTURE_PIXELS + CAPTURE_PIXELS / 2];
+static uint32_t capture_num_frames;
+static uint32_t capture_num_samples;
+
+// Returns the number of 16-bit values written to dst. Only runs of 3 or more
+// values are compressed, so the output is never much bigger than the input.
+static size_t Capture_EncodeRLE(const uint16_t *src, size_t count,
+                                uint16_t *dst)
+{
+    size_t out = 0;
+    size_t literal_start = 0;
+    size_t i = 0;
+
+    while (i <= count)
+    {
+        size_t run = 0;
+
+        if (i < count)
+        {
+            uint16_t value = src[i];
+            run = 1;
+            while ((i + run < count) && (src[i + run] == value) &&
+                   (run < 0x7FFF))
+                run++;
+
+            if (run < 3)
+            {
+                i += run;
+                continue;
+            }
+        }
+
+        // Flush pending literals before the run (or at the end of the data)
+        while (literal_start < i)
+        {
+            size_t size = i - literal_start;
+            if (size > 0x7FFF)
+                size = 0x7FFF;
+
+            dst[out++] = size;
+            memcpy(&dst[out], &src[literal_start], size * sizeof(uint16_t));
+            out += size;
+            literal_start += size;
+        }
+
+        if (i == count)
+            break;
+
+        dst[out++] = 0x8000 | run;
+        dst[out++] = src[i];
+
+        i += run;
+        literal_start = i;
+    }
+
+    return out;
+}
+
+static void Capture_WriteChunk(uint32_t id, const void *data, uint32_t size)
+{
+    capture_chunk_t chunk = {
+        .id = id,
+        .size = size,
+    };
+
+    CaptureIO_Write(capture_file_handle, &chunk, sizeof(chunk));
+    CaptureIO_Write(capture_file_handle, data, size);
+}
+
+static void Capture_EncodeFrame(const capture_frame_t *frame)
+{
+    uint32_t id;
+    const uint16_t *src;
+
+    if ((capture_num_frames % CAPTURE_KEYFRAME_INTERVAL) == 0)
+    {
+        id = CAPTURE_CHUNK_KEY;
+        src = frame->pixels;
+    }
+    else
+    {
+        // Most pixels don't change between frames, so the XOR creates long
+        // runs of zeroes.
+        for (int i = 0; i < CAPTURE_PIXELS; i++)
+            capture_delta[i] = frame->pixels[i] ^ capture_prev_frame[i];
+
+        id = CAPTURE_CHUNK_DELTA;
+        src = capture_delta;
+    }
+
+    size_t size = Capture_EncodeRLE(src, CAPTURE_PIXELS, capture_rle);
+    Capture_WriteChunk(id, capture_rle, size * sizeof(uint16_t));
+
+    memcpy(capture_prev_frame, frame->pixels, sizeof(capture_prev_frame));
+
+    if (frame->num_samples > 0)
+    {
+        Capture_WriteChunk(CAPTURE_CHUNK_AUDIO, frame->audio,
+                           frame->num_samples * 2 * sizeof(int16_t));
+    }
+
+    capture_num_frames++;
+    capture_num_samples += frame->num_samples;
+}
+
+static int Capture_Thread(void *data)
+{
+    (void)data;
+
+    SDL_LockMutex(capture_mutex);
+
+    while (1)
+    {
+        while ((capture_queue_count == 0) && (capture_quit == 0))
+            SDL_CondWait(capture_cond, capture_mutex);
+
+        if (capture_queue_count == 0)
+            break;
+
+        capture_frame_t *frame = &capture_frames[capture_queue_head];
+
+        SDL_UnlockMutex(capture_mutex);
+
+        // The game thread doesn't touch this frame until it is released
+        Capture_EncodeFrame(frame);
+
+        SDL_LockMutex(capture_mutex);
+
+        capture_queue_head = (capture_queue_head + 1) % CAPTURE_QUEUE_FRAMES;
+        capture_queue_count--;
+
+        SDL_CondBroadcast(capture_cond);
+    }
+
+    SDL_UnlockMutex(capture_mutex);
+
+    return 0;
+}
+
+static void Capture_SoundStream(int16_t *buffer, size_t size)
+{
+    uint32_t samples = size / (2 * sizeof(int16_t));
+
+    if (capture_audio_samples + samples > CAPTURE_MAX_SAMPLES)
+    {
+        Debug_Log("%s(): Too many samples in one frame", __func__);
+        samples = CAPTURE_MAX_SAMPLES - capture_audio_samples;
+    }
+
+    memcpy(&capture_audio[capture_audio_samples * 2], buffer,
+           samples * 2 * sizeof(int16_t));
+    capture_audio_samples += samples;
+}
+
+void Capture_End(void)
+{
+    if (capture_file_handle == NULL)
+        return;
+
+    Sound_SinkRemove(Capture_SoundStream);
+
+    // Let the encoder thread compress all the frames left in the queue
+
+    SDL_LockMutex(capture_mutex);
+    capture_quit = 1;
+    SDL_CondBroadcast(capture_cond);
+    SDL_UnlockMutex(capture_mutex);
+
+    SDL_WaitThread(capture_thread, NULL);
+    capture_thread = NULL;
+
+    capture_header_t header = {
+        .magic = CAPTURE_MAGIC,
+        .version = CAPTURE_VERSION,
+        .header_size = sizeof(capture_header_t),
+        .width = CAPTURE_WIDTH,
+        .height = CAPTURE_HEIGHT,
+        .clocks_per_second = GBA_CLOCKS_PER_SECOND,
+        .clocks_per_frame = GBA_CLOCKS_PER_FRAME,
+        .sample_rate = GBA_SAMPLERATE,
+        .num_channels = 2,
+        .bits_per_sample = 16,
+        .keyframe_interval = CAPTURE_KEYFRAME_INTERVAL,
+        .num_frames = capture_num_frames,
+        .num_samples = capture_num_samples,
+    };
+
+    if (CaptureIO_Close(capture_file_handle, &header, sizeof(header)) != 0)
+        Debug_Log("%s(): Failed to save file.", __func__);
+
+    capture_file_handle = NULL;
+
+    Debug_Log("%s: Frames: %u. Max frames queued: %d. Game thread waited: %u",
+              __func__, capture_num_frames, capture_max_queued, capture_stalls);
+
+    SDL_DestroyCond(capture_cond);
+    SDL_DestroyMutex(capture_mutex);
+    capture_cond = NULL;
+    capture_mutex = NULL;
+
+    free(capture_frames);
+    capture_frames = NULL;
+}
+
+int Capture_Start(const char *path)
+{
+    if (path == NULL)
+        path = "capture.ugbc";
+
+    if (capture_file_handle)
+        Capture_End();
+
+    capture_frames = malloc(CAPTURE_QUEUE_FRAMES * sizeof(capture_frame_t));
+    if (capture_frames == NULL)
+    {
+        Debug_Log("%s(): Not enough memory", __func__);
+        return 1;
+    }
+
+    capture_mutex = SDL_CreateMutex();
+    capture_cond = SDL_CreateCond();
+    if ((capture_mutex == NULL) || (capture_cond == NULL))
+    {
+        Debug_Log("%s(): Can't create mutex: %s", __func__, SDL_GetError());
+        goto error;
+    }
+
+    capture_file_handle = CaptureIO_Open(path, sizeof(capture_header_t));
+    if (capture_file_handle == NULL)
+        goto error;
+
+    // No data can be lost. If the disk is too slow the encoder thread waits,
+    // and the game thread only waits when the queue of frames is full.
+    CaptureIO_SetBlocking(capture_file_handle, 1);
+
+    capture_queue_head = 0;
+    capture_queue_count = 0;
+    capture_quit = 0;
+
+    capture_audio_samples = 0;
+    capture_stalls = 0;
+    capture_max_queued = 0;
+
+    capture_num_frames = 0;
+    capture_num_samples = 0;
+
+    capture_thread = SDL_CreateThread(Capture_Thread, "Capture encoder", NULL);
+    if (capture_thread == NULL)
+    {
+        Debug_Log("%s(): Can't create thread: %s", __func__, SDL_GetError());
+        CaptureIO_Close(capture_file_handle, NULL, 0);
+        capture_file_handle = NULL;
+        goto error;
+    }
+
+    // Close file when the program exits
+    atexit(Capture_End);
+
+    // Receive the samples generated every frame
+    Sound_SinkAdd(Capture_SoundStream);
+
+    return 0;
+
+error:
+    if (capture_cond)
+        SDL_DestroyCond(capture_cond);
+    if (capture_mutex)
+        SDL_DestroyMutex(capture_mutex);
+    capture_cond = NULL;
+    capture_mutex = NULL;
+
+    free(capture_frames);
+    capture_frames = NULL;
+
+    return 1;
+}
+
+int Capture_IsRunning(void)
+{
+    if (capture_file_handle == NULL)
+        return 0;
+
+    return 1;
+}
+
+void Capture_HandleFrame(void)
+{
+    if (capture_file_handle == NULL)
+        return;
+
+    SDL_LockMutex(capture_mutex);
+
+    if (capture_queue_count == CAPTURE_QUEUE_FRAMES)
+    {
+        capture_stalls++;
+
+        while (capture_queue_count == CAPTURE_QUEUE_FRAMES)
+            SDL_CondWait(capture_cond, capture_mutex);
+    }
+
+    int index = (capture_queue_head + capture_queue_count)
+              % CAPTURE_QUEUE_FRAMES;
+
+    SDL_UnlockMutex(capture_mutex);
+
+    // The encoder thread doesn't use this frame until it is in the queue
+
+    capture_frame_t *frame = &capture_frames[index];
+
+    memcpy(frame->pixels, GBA_GetScreenBuffer(), sizeof(frame->pixels));
+
+    memcpy(frame->audio, capture_audio,
+           capture_audio_samples * 2 * sizeof(int16_t));
+    frame->num_samples = capture_audio_samples;
+    capture_audio_samples = 0;
+
+    SDL_LockMutex(capture_mutex);
+
+    capture_queue_count++;
+    if (capture_queue_count > capture_max_queued)
+        capture_max_queued = capture_queue_count;
+
+    SDL_CondBroadcast(capture_cond);
+
+    SDL_UnlockMutex(capture_mutex);
+}
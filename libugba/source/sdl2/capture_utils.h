@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: LGPL-3.0-only
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+#ifndef SDL2_CAPTURE_UTILS_H__
+#define SDL2_CAPTURE_UTILS_H__
+
+#include <stdint.h>
+
+// A capture file stores every frame shown on the screen and all the audio
+// generated while recording, without any loss of quality. The frames are
+// compressed by a separate thread, and the emulation only waits for it if the
+// disk can't keep up with the data (no frame is ever dropped).
+//
+// Format (all values are little endian):
+//
+// - Header (capture_header_t in capture_utils.c).
+// - One or more chunks. Each chunk starts with two 32-bit values: a chunk ID
+//   and the size of the data that follows it in bytes. For every frame there
+//   is a video chunk followed by an audio chunk (unless there is no audio).
+//
+//   - "FKEY": Keyframe. RLE-compressed RGB555 pixels of the frame.
+//   - "FDLT": Delta frame. RLE-compressed result of the XOR of the pixels of
+//     the frame with the pixels of the previous frame.
+//   - "AUDP": Stereo 16-bit PCM samples at the sample rate in the header.
+//
+// The RLE data is a list of 16-bit tokens. If bit 15 of a token is set, the
+// next 16-bit value is repeated (token & 0x7FFF) times. If not, it is followed
+// by (token & 0x7FFF) values that are copied as they are.
+
+// Start recording to a capture file. If the path is NULL, it defaults to
+// "capture.ugbc". Returns 0 on success.
+int Capture_Start(const char *path);
+
+// Stop recording and write the header of the file
+void Capture_End(void);
+
+int Capture_IsRunning(void);
+
+// Called by the game thread once per frame, after the audio of the frame has
+// been generated.
+void Capture_HandleFrame(void);
+
+#endif // SDL2_CAPTURE_UTILS_H__
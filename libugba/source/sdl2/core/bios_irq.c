@@ -9,11 +9,14 @@
 #include "interrupts.h"
 #include "dma.h"
 #include "sound.h"
+#include "timer.h"
 #include "video.h"
 
+#include "../capture_utils.h"
 #include "../debug_utils.h"
 #include "../input_utils.h"
 #include "../lua_handler.h"
+#include "../movie_utils.h"
 
 #include "../gui/win_main.h"
 #include "../gui/window_handler.h"
@@ -78,28 +81,8 @@ static void handle_hbl_during_vbl(void)
     IRQ_Internal_CallHandler(IRQ_HBLANK);
 }
 
-static void handle_vbl(void)
+static void handle_input(void)
 {
-    // Handle DMA if active
-    GBA_DMAHandleVBL();
-
-    // Handle sound before calling the VBL interrupt handler
-    Sound_Handle_VBL();
-
-    // Handle VBL interrupt
-    IRQ_Internal_CallHandler(IRQ_VBLANK);
-
-    // Handle GUI
-    // ----------
-
-    // Handle events for all windows
-    WH_HandleEvents();
-
-    Win_MainLoopHandle();
-
-    // Render main window every frame
-    Win_MainRender();
-
     // Update input state. Do this before invoking the script handler, as the
     // script can overwrite the input.
     Input_Update_GBA();
@@ -109,11 +92,17 @@ static void handle_vbl(void)
     Script_FrameDrawn();
 #endif
 
+    // Record the final input of this frame, or replace it by the one saved in
+    // the movie that is being replayed.
+    Movie_HandleFrame();
+
     // Now that the user and the script input have been handled, check
     // keypad interrupt
     Input_Handle_Interrupt();
+}
 
-    // Synchronise video
+static void sync_video(void)
+{
     if (Input_Speedup_Enabled())
     {
         SDL_Delay(0);
@@ -137,6 +126,55 @@ static void handle_vbl(void)
     }
 }
 
+static void handle_vbl(void)
+{
+    // Handle DMA if active
+    GBA_DMAHandleVBL();
+
+    // Handle sound before calling the VBL interrupt handler
+    Sound_Handle_VBL();
+
+    // Save the frame and the audio that has just been generated
+    Capture_HandleFrame();
+
+    if (Input_LatePollingEnabled())
+    {
+        // Present the frame and wait for the next one before handling events
+        // and sampling the input. The VBL interrupt handler is called at the
+        // end so that it can also see the new input.
+
+        Win_MainLoopHandle();
+        Win_MainRender();
+
+        sync_video();
+
+        WH_HandleEvents();
+
+        handle_input();
+
+        IRQ_Internal_CallHandler(IRQ_VBLANK);
+    }
+    else
+    {
+        // Handle VBL interrupt
+        IRQ_Internal_CallHandler(IRQ_VBLANK);
+
+        // Handle events for all windows
+        WH_HandleEvents();
+
+        Win_MainLoopHandle();
+
+        // Render main window every frame
+        Win_MainRender();
+
+        handle_input();
+
+        sync_video();
+    }
+
+    Input_GameResumed();
+}
+
 static void do_scanline_draw(void)
 {
     if (current_vcount < 160)
@@ -153,6 +191,8 @@ static void do_scanline_draw(void)
         handle_hbl_during_vbl();
     }
 
+    GBA_TimerHandleScanline();
+
     current_vcount++;
 
     if (current_vcount == 228)
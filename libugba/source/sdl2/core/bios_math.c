@@ -1,39 +1,66 @@
 // SPDX-License-Identifier: LGPL-3.0-only
 //
-// Copyright (c) 2020 Antonio Niño Díaz
+// Copyright (c) 2020-2021 Antonio Niño Díaz
 
 #include <math.h>
 
 #include <ugba/ugba.h>
 
 #include "../debug_utils.h"
+#include "../simd.h"
 
 int32_t SWI_Div(int32_t num, int32_t div)
 {
     if (div == 0)
         return 0;
 
+    // The result of this division doesn't fit in 32 bits, and it makes the CPU
+    // raise an exception on some hosts. The BIOS returns the same value.
+    if ((num == INT32_MIN) && (div == -1))
+        return INT32_MIN;
+
     return num / div;
 }
 
 int32_t SWI_DivMod(int32_t num, int32_t div)
 {
-    if (div == 0)
+    if ((div == 0) || (div == -1))
         return 0;
 
     return num % div;
 }
 
+int32_t SWI_DivAndMod(int32_t num, int32_t div, int32_t *mod)
+{
+    if (div == 0)
+    {
+        *mod = 0;
+        return 0;
+    }
+
+    if (div == -1)
+    {
+        *mod = 0;
+        return (num == INT32_MIN) ? INT32_MIN : -num;
+    }
+
+    // Compilers generate a single division instruction for both operations
+    *mod = num % div;
+    return num / div;
+}
+
 uint16_t SWI_Sqrt(uint32_t value)
 {
+    // A double can hold any 32-bit integer and the result of sqrt() is
+    // correctly rounded, so the truncated result is always the exact integer
+    // square root. This is faster than any integer implementation on the host.
     return (uint16_t)sqrt(value);
 }
 
-int16_t SWI_ArcTan(int16_t tan)
+// This is what the BIOS does... Not accurate at the bounds. It returns the
+// polynomial that has to be multiplied by the tangent to get the arc tangent.
+static int32_t ArcTan_Polynomial(int32_t r0)
 {
-    int32_t r0 = tan;
-
-    // This is what the BIOS does... Not accurate at the bounds.
     int32_t r1 = -((r0 * r0) >> 14);
     int32_t r3 = ((((int32_t)0xA9) * r1) >> 14) + 0x390;
     r3 = ((r1 * r3) >> 14) + 0x91C;
@@ -42,7 +69,51 @@ int16_t SWI_ArcTan(int16_t tan)
     r3 = ((r1 * r3) >> 14) + 0x2081;
     r3 = ((r1 * r3) >> 14) + 0x3651;
     r3 = ((r1 * r3) >> 14) + 0xA259;
-    int32_t result = (r0 * r3) >> 16;
+
+    return r3;
+}
+
+// The polynomial only depends on the square of the tangent, so it is the same
+// for positive and negative values. SWI_ArcTan2() only uses tangents between
+// -1.0 and 1.0, so the polynomial of all of them is calculated once. The
+// multiplication by the tangent is still done in each call so that the results
+// are exactly the same as with the polynomial.
+
+#define ARCTAN_TABLE_MAX    (1 << 14) // 1.0 in 2.14 format
+
+static uint16_t arctan_table[ARCTAN_TABLE_MAX + 1];
+static int arctan_table_ready = 0;
+
+static void ArcTan_TableInit(void)
+{
+    if (arctan_table_ready)
+        return;
+
+    for (int32_t i = 0; i <= ARCTAN_TABLE_MAX; i++)
+        arctan_table[i] = ArcTan_Polynomial(i);
+
+    arctan_table_ready = 1;
+}
+
+// The tangent must be between -1.0 and 1.0
+static inline int16_t ArcTan_Table(int32_t r0)
+{
+    int32_t r3 = arctan_table[(r0 < 0) ? -r0 : r0];
+
+    return (r0 * r3) >> 16;
+}
+
+int16_t SWI_ArcTan(int16_t tan)
+{
+    int32_t r0 = tan;
+
+    if ((r0 >= -ARCTAN_TABLE_MAX) && (r0 <= ARCTAN_TABLE_MAX))
+    {
+        ArcTan_TableInit();
+        return ArcTan_Table(r0);
+    }
+
+    int32_t result = (r0 * ArcTan_Polynomial(r0)) >> 16;
 
     return result;
 
@@ -58,6 +129,8 @@ int16_t SWI_ArcTan2(int16_t x, int16_t y)
     int32_t x_ = x;
     int32_t y_ = y;
 
+    ArcTan_TableInit();
+
     if (y_ == 0)
     {
         if (x_ < 0)
@@ -79,29 +152,29 @@ int16_t SWI_ArcTan2(int16_t x, int16_t y)
         if (x_ >= 0)
         {
             if (x_ < y_)
-                return 0x4000 - SWI_ArcTan((x_ << 14) / y_);
+                return 0x4000 - ArcTan_Table((x_ << 14) / y_);
 
-            return SWI_ArcTan((y_ << 14) / x_);
+            return ArcTan_Table((y_ << 14) / x_);
         }
 
         if (-x_ < y_)
-            return 0x4000 - SWI_ArcTan((x_ << 14) / y_);
+            return 0x4000 - ArcTan_Table((x_ << 14) / y_);
 
-        return 0x8000 + SWI_ArcTan((y_ << 14) / x_);
+        return 0x8000 + ArcTan_Table((y_ << 14) / x_);
     }
 
     if (x_ > 0)
     {
         if (x_ < -y_)
-            return 0xC000 - SWI_ArcTan((x_ << 14) / y_);
+            return 0xC000 - ArcTan_Table((x_ << 14) / y_);
 
-        return 0x10000 + SWI_ArcTan((y_ << 14) / x_);
+        return 0x10000 + ArcTan_Table((y_ << 14) / x_);
     }
 
     if (-x_ > -y_)
-        return 0x8000 + SWI_ArcTan((y_ << 14) / x_);
+        return 0x8000 + ArcTan_Table((y_ << 14) / x_);
 
-    return 0xC000 - SWI_ArcTan((x_ << 14) / y_);
+    return 0xC000 - ArcTan_Table((x_ << 14) / y_);
 
     // Emulated: Accurate always
     // float x_ = ((float)x) / (float)(1 << 14);
@@ -112,9 +185,37 @@ int16_t SWI_ArcTan2(int16_t x, int16_t y)
     // return result;
 }
 
+// The affine functions only use the top 8 bits of the angle, so the sine and
+// cosine of all 256 possible angles are calculated once and shared by all of
+// them. The values are calculated with the same expression that was used when
+// they were calculated for each call, so the results don't change.
+
+static float affine_sin[256];
+static float affine_cos[256];
+static int affine_table_ready = 0;
+
+static void Affine_TableInit(void)
+{
+    if (affine_table_ready)
+        return;
+
+    for (int i = 0; i < 256; i++)
+    {
+        float angle = (float)2.0 * (float)M_PI
+                      * (((float)(uint8_t)i) / (float)0xFF);
+
+        affine_sin[i] = sin(angle);
+        affine_cos[i] = cos(angle);
+    }
+
+    affine_table_ready = 1;
+}
+
 void SWI_BgAffineSet(const bg_affine_src *src, bg_affine_dst *dst,
                      uint32_t count)
 {
+    Affine_TableInit();
+
     while (count--)
     {
         int32_t cx = src->bgx;
@@ -123,11 +224,10 @@ void SWI_BgAffineSet(const bg_affine_src *src, bg_affine_dst *dst,
         float dispy = (float)src->scry;
         float sx = ((float)src->scalex) / (float)(1 << 8);
         float sy = ((float)src->scaley) / (float)(1 << 8);
-        float angle = (float)2.0 * (float)M_PI
-                      * (((float)(uint8_t)(src->angle >> 8)) / (float)0xFF);
+        uint8_t angle = src->angle >> 8;
 
-        float sin_ = sin(angle);
-        float cos_ = cos(angle);
+        float sin_ = affine_sin[angle];
+        float cos_ = affine_cos[angle];
         dst->pa = cos_ * (float)(1 << 8) * sx;
         dst->pb = -sin_ * (float)(1 << 8) * sx;
         dst->pc = sin_ * (float)(1 << 8) * sy;
@@ -143,6 +243,89 @@ void SWI_BgAffineSet(const bg_affine_src *src, bg_affine_dst *dst,
     }
 }
 
+// Calculates the matrices of 4 objects at a time and saves them to the
+// specified arrays. It returns the number of matrices calculated. The
+// operations are done in the same order as in the scalar loop so that the
+// results are exactly the same.
+static uint32_t ObjAffineSet_Vector(const obj_affine_src *src, uint32_t count,
+                                    int16_t *pa, int16_t *pb, int16_t *pc,
+                                    int16_t *pd)
+{
+#if defined(UGBA_SSE2) || defined(UGBA_NEON)
+    uint32_t i;
+
+    for (i = 0; i + 4 <= count; i += 4)
+    {
+        float sx[4], sy[4], sin_[4], cos_[4];
+
+        for (int j = 0; j < 4; j++)
+        {
+            uint8_t angle = src[i + j].angle >> 8;
+
+            sx[j] = src[i + j].sx;
+            sy[j] = src[i + j].sy;
+            sin_[j] = affine_sin[angle];
+            cos_[j] = affine_cos[angle];
+        }
+
+        int32_t a[4], b[4], c[4], d[4];
+
+# if defined(UGBA_SSE2)
+        const __m128 scale = _mm_set1_ps((float)(1 << 8));
+
+        __m128 vsx = _mm_div_ps(_mm_loadu_ps(sx), scale);
+        __m128 vsy = _mm_div_ps(_mm_loadu_ps(sy), scale);
+        __m128 vsin = _mm_mul_ps(_mm_loadu_ps(sin_), scale);
+        __m128 vcos = _mm_mul_ps(_mm_loadu_ps(cos_), scale);
+        __m128 vnsin = _mm_xor_ps(vsin, _mm_set1_ps(-0.0f));
+
+        __m128i va = _mm_cvttps_epi32(_mm_mul_ps(vcos, vsx));
+        __m128i vb = _mm_cvttps_epi32(_mm_mul_ps(vnsin, vsx));
+        __m128i vc = _mm_cvttps_epi32(_mm_mul_ps(vsin, vsy));
+        __m128i vd = _mm_cvttps_epi32(_mm_mul_ps(vcos, vsy));
+
+        _mm_storeu_si128((__m128i *)a, va);
+        _mm_storeu_si128((__m128i *)b, vb);
+        _mm_storeu_si128((__m128i *)c, vc);
+        _mm_storeu_si128((__m128i *)d, vd);
+# else
+        const float32x4_t scale = vdupq_n_f32((float)(1 << 8));
+
+        float32x4_t vsx = vmulq_f32(vld1q_f32(sx),
+                                    vdupq_n_f32(1.0f / (float)(1 << 8)));
+        float32x4_t vsy = vmulq_f32(vld1q_f32(sy),
+                                    vdupq_n_f32(1.0f / (float)(1 << 8)));
+        float32x4_t vsin = vmulq_f32(vld1q_f32(sin_), scale);
+        float32x4_t vcos = vmulq_f32(vld1q_f32(cos_), scale);
+        float32x4_t vnsin = vnegq_f32(vsin);
+
+        vst1q_s32(a, vcvtq_s32_f32(vmulq_f32(vcos, vsx)));
+        vst1q_s32(b, vcvtq_s32_f32(vmulq_f32(vnsin, vsx)));
+        vst1q_s32(c, vcvtq_s32_f32(vmulq_f32(vsin, vsy)));
+        vst1q_s32(d, vcvtq_s32_f32(vmulq_f32(vcos, vsy)));
+# endif
+
+        for (int j = 0; j < 4; j++)
+        {
+            pa[i + j] = a[j];
+            pb[i + j] = b[j];
+            pc[i + j] = c[j];
+            pd[i + j] = d[j];
+        }
+    }
+
+    return i;
+#else
+    (void)src;
+    (void)count;
+    (void)pa;
+    (void)pb;
+    (void)pc;
+    (void)pd;
+    return 0;
+#endif
+}
+
 void SWI_ObjAffineSet(const obj_affine_src *src, void *dst,
                       uint32_t count, uint32_t increment)
 {
@@ -151,30 +334,48 @@ void SWI_ObjAffineSet(const obj_affine_src *src, void *dst,
         Debug_Log("%s: Please, set increment to a multiple of 2", __func__);
     }
 
+    Affine_TableInit();
+
     int16_t *out = dst;
 
-    for (uint32_t i = 0; i < count; i++)
+    // The matrices are calculated in blocks and then copied to the destination
+    // with the right spacing between values.
+
+    while (count > 0)
     {
-        float sx = ((float)src->sx) / (float)(1 << 8);
-        float sy = ((float)src->sy) / (float)(1 << 8);
-        float angle = (float)2.0 * (float)M_PI
-                      * (((float)(uint8_t)(src->angle >> 8)) / (float)0xFF);
-        src++;
+        int16_t pa[32], pb[32], pc[32], pd[32];
+
+        uint32_t block = (count > 32) ? 32 : count;
+
+        uint32_t i = ObjAffineSet_Vector(src, block, pa, pb, pc, pd);
+
+        for ( ; i < block; i++)
+        {
+            float sx = ((float)src[i].sx) / (float)(1 << 8);
+            float sy = ((float)src[i].sy) / (float)(1 << 8);
+            uint8_t angle = src[i].angle >> 8;
+
+            float sin_ = affine_sin[angle];
+            float cos_ = affine_cos[angle];
+            pa[i] = (int16_t)(cos_ * (float)(1 << 8) * sx);
+            pb[i] = (int16_t)(-sin_ * (float)(1 << 8) * sx);
+            pc[i] = (int16_t)(sin_ * (float)(1 << 8) * sy);
+            pd[i] = (int16_t)(cos_ * (float)(1 << 8) * sy);
+        }
+
+        for (i = 0; i < block; i++)
+        {
+            *out = pa[i];
+            out += increment / 2;
+            *out = pb[i];
+            out += increment / 2;
+            *out = pc[i];
+            out += increment / 2;
+            *out = pd[i];
+            out += increment / 2;
+        }
 
-        float sin_ = sin(angle);
-        float cos_ = cos(angle);
-        int16_t A = (int16_t)(cos_ * (float)(1 << 8) * sx);
-        int16_t B = (int16_t)(-sin_ * (float)(1 << 8) * sx);
-        int16_t C = (int16_t)(sin_ * (float)(1 << 8) * sy);
-        int16_t D = (int16_t)(cos_ * (float)(1 << 8) * sy);
-
-        *out = A;
-        out += increment / 2;
-        *out = B;
-        out += increment / 2;
-        *out = C;
-        out += increment / 2;
-        *out = D;
-        out += increment / 2;
+        src += block;
+        count -= block;
     }
 }
@@ -1,13 +1,13 @@
 // SPDX-License-Identifier: LGPL-3.0-only
 //
-// Copyright (c) 2020 Antonio Niño Díaz
+// Copyright (c) 2020-2021 Antonio Niño Díaz
 
-#include <stdlib.h>
 #include <string.h>
 
 #include <ugba/ugba.h>
 
 #include "../debug_utils.h"
+#include "../simd.h"
 
 void SWI_RegisterRamReset(uint32_t flags)
 {
@@ -145,9 +145,80 @@ uint32_t SWI_GetBiosChecksum(void)
     return SWI_CHECKSUM_GBA;
 }
 
+// The first pattern_size bytes of dst contain a pattern. Repeat it until size
+// bytes have been written. The size of the block that is copied keeps doubling,
+// and it is always a multiple of the size of the pattern.
+static void Memory_RepeatPattern(uint8_t *dst, size_t pattern_size, size_t size)
+{
+    size_t done = pattern_size;
+
+    while (done < size)
+    {
+        size_t len = size - done;
+        if (len > done)
+            len = done;
+
+        memcpy(dst + done, dst, len);
+        done += len;
+    }
+}
+
+// Copy that behaves like a loop that copies one element at a time from the
+// start to the end. If the destination starts inside the source, the data
+// that hasn't been copied yet is overwritten, and the result is a repetition
+// of the first (dst - src) bytes.
+static void Memory_CopyForward(void *dst, const void *src, size_t size)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+
+    if ((d <= s) || (d >= s + size))
+    {
+        memmove(d, s, size);
+        return;
+    }
+
+    size_t distance = d - s;
+
+    memcpy(d, s, distance);
+    Memory_RepeatPattern(d, distance, size);
+}
+
+static void Memory_Fill16(uint16_t *dst, uint16_t fill, size_t count)
+{
+    if (count == 0)
+        return;
+
+    if ((fill & 0xFF) == (fill >> 8))
+    {
+        memset(dst, fill & 0xFF, count * sizeof(uint16_t));
+        return;
+    }
+
+    dst[0] = fill;
+    Memory_RepeatPattern((uint8_t *)dst, sizeof(uint16_t),
+                         count * sizeof(uint16_t));
+}
+
+static void Memory_Fill32(uint32_t *dst, uint32_t fill, size_t count)
+{
+    if (count == 0)
+        return;
+
+    if (fill == (fill & 0xFF) * 0x01010101U)
+    {
+        memset(dst, fill & 0xFF, count * sizeof(uint32_t));
+        return;
+    }
+
+    dst[0] = fill;
+    Memory_RepeatPattern((uint8_t *)dst, sizeof(uint32_t),
+                         count * sizeof(uint32_t));
+}
+
 void SWI_CpuSet(const void *src, void *dst, uint32_t len_mode)
 {
-    int count = len_mode & 0x001FFFFF;
+    uint32_t count = len_mode & 0x001FFFFF;
     uint32_t mode = len_mode & ~0x001FFFFF;
 
     if (mode & SWI_MODE_32BIT)
@@ -156,16 +227,9 @@ void SWI_CpuSet(const void *src, void *dst, uint32_t len_mode)
         uint32_t *dst_ = (uint32_t *)((uintptr_t)dst & ~3);
 
         if (mode & SWI_MODE_FILL)
-        {
-            uint32_t fill = *src_;
-            while (count--)
-                *dst_++ = fill;
-        }
+            Memory_Fill32(dst_, *src_, count);
         else // Copy
-        {
-            while (count--)
-                *dst_++ = *src_++;
-        }
+            Memory_CopyForward(dst_, src_, count * sizeof(uint32_t));
     }
     else // 16 bit
     {
@@ -173,41 +237,29 @@ void SWI_CpuSet(const void *src, void *dst, uint32_t len_mode)
         uint16_t *dst_ = (uint16_t *)((uintptr_t)dst & ~1);
 
         if (mode & SWI_MODE_FILL)
-        {
-            uint16_t fill = *src_;
-            while (count--)
-                *dst_++ = fill;
-        }
+            Memory_Fill16(dst_, *src_, count);
         else // Copy
-        {
-            while (count--)
-                *dst_++ = *src_++;
-        }
+            Memory_CopyForward(dst_, src_, count * sizeof(uint16_t));
     }
 }
 
 void SWI_CpuFastSet(const void *src, void *dst, uint32_t len_mode)
 {
-    int count = len_mode & 0x001FFFF8; // Must be a multiple of 8 words
+    uint32_t count = len_mode & 0x001FFFF8; // Must be a multiple of 8 words
     uint32_t mode = len_mode & ~0x001FFFFF;
 
     uint32_t *src_ = (uint32_t *)((uintptr_t)src & ~3);
     uint32_t *dst_ = (uint32_t *)((uintptr_t)dst & ~3);
 
     if (mode & SWI_MODE_FILL)
-    {
-        uint32_t fill = *src_;
-        while (count--)
-            *dst_++ = fill;
-    }
+        Memory_Fill32(dst_, *src_, count);
     else // Copy
-    {
-        while (count--)
-            *dst_++ = *src_++;
-    }
+        Memory_CopyForward(dst_, src_, count * sizeof(uint32_t));
 }
 
-void SWI_BitUnPack(const void *source, void *dest, const bit_unpack_info *info)
+// Generic implementation. It is only used if the widths aren't valid.
+static void SWI_BitUnPack_Generic(const void *source, void *dest,
+                                  const bit_unpack_info *info)
 {
     const uint8_t *src = source;
     uint32_t *dst = dest;
@@ -305,13 +357,173 @@ void SWI_BitUnPack(const void *source, void *dest, const bit_unpack_info *info)
     }
 }
 
+// Every source byte expands to the same bits in the destination, so the result
+// of each possible source byte is saved in a table, including the data offset.
+// The table is reused while the arguments don't change.
+//
+// Each byte expands to (8 / source_width) * dest_width bits. If that is 32 bits
+// or more, the table holds all the words generated by a byte. If not, several
+// table entries are combined to form a word.
+
+#define BITUNPACK_MAX_WORDS     (8) // A byte expanded from 1 to 32 bits
+
+static uint32_t bitunpack_table[256 * BITUNPACK_MAX_WORDS];
+static int bitunpack_source_width;
+static int bitunpack_dest_width;
+static uint32_t bitunpack_data_offset;
+
+static int BitUnPack_ValidWidths(int source_width, int dest_width)
+{
+    if ((source_width != 1) && (source_width != 2) && (source_width != 4) &&
+        (source_width != 8))
+        return 0;
+
+    if ((dest_width != 1) && (dest_width != 2) && (dest_width != 4) &&
+        (dest_width != 8) && (dest_width != 16) && (dest_width != 32))
+        return 0;
+
+    return 1;
+}
+
+static void BitUnPack_PrepareTable(const bit_unpack_info *info)
+{
+    int source_width = info->source_width;
+    int dest_width = info->dest_width;
+
+    if ((bitunpack_source_width == source_width) &&
+        (bitunpack_dest_width == dest_width) &&
+        (bitunpack_data_offset == info->data_offset))
+        return;
+
+    uint32_t dataoffset = info->data_offset & ~SWI_BITUNPACK_OFFSET_ZERO;
+    int zerodataflag = info->data_offset & SWI_BITUNPACK_OFFSET_ZERO;
+
+    int values = 8 / source_width;
+    int byte_bits = values * dest_width;
+    int stride = (byte_bits > 32) ? (byte_bits / 32) : 1;
+    uint32_t mask = (1 << source_width) - 1;
+
+    for (int b = 0; b < 256; b++)
+    {
+        uint32_t *entry = &bitunpack_table[b * stride];
+
+        for (int w = 0; w < stride; w++)
+            entry[w] = 0;
+
+        for (int k = 0; k < values; k++)
+        {
+            uint32_t data = (b >> (k * source_width)) & mask;
+
+            // Same rules as in the generic implementation
+            if (data)
+                data += dataoffset;
+            else if (zerodataflag)
+                data += dataoffset;
+
+            int bit = k * dest_width;
+            entry[bit / 32] |= data << (bit % 32);
+        }
+    }
+
+    bitunpack_source_width = source_width;
+    bitunpack_dest_width = dest_width;
+    bitunpack_data_offset = info->data_offset;
+}
+
+void SWI_BitUnPack(const void *source, void *dest, const bit_unpack_info *info)
+{
+    if (!BitUnPack_ValidWidths(info->source_width, info->dest_width))
+    {
+        SWI_BitUnPack_Generic(source, dest, info);
+        return;
+    }
+
+    BitUnPack_PrepareTable(info);
+
+    const uint8_t *src = source;
+    uint32_t *dst = dest;
+    uint32_t srcsize = info->source_length;
+
+    const uint32_t *table = bitunpack_table;
+    int byte_bits = (8 / info->source_width) * info->dest_width;
+
+    if (byte_bits == 32) // 1 to 4, 2 to 8, 4 to 16, 8 to 32 bits
+    {
+        for (uint32_t i = 0; i < srcsize; i++)
+            dst[i] = table[src[i]];
+    }
+    else if (byte_bits == 64) // 1 to 8, 2 to 16, 4 to 32 bits
+    {
+        for (uint32_t i = 0; i < srcsize; i++)
+        {
+            const uint32_t *entry = &table[src[i] * 2];
+            dst[i * 2] = entry[0];
+            dst[i * 2 + 1] = entry[1];
+        }
+    }
+    else if (byte_bits > 64) // 1 to 16, 1 to 32, 2 to 32 bits
+    {
+        int stride = byte_bits / 32;
+
+        for (uint32_t i = 0; i < srcsize; i++)
+        {
+            memcpy(dst, &table[src[i] * stride], stride * sizeof(uint32_t));
+            dst += stride;
+        }
+    }
+    else if (byte_bits == 16) // 1 to 2, 2 to 4, 4 to 8, 8 to 16 bits
+    {
+        // An incomplete word at the end isn't written
+        for (uint32_t i = 0; i + 2 <= srcsize; i += 2)
+            *dst++ = table[src[i]] | (table[src[i + 1]] << 16);
+    }
+    else // 8 bits or less per byte
+    {
+        int bytes_per_word = 32 / byte_bits;
+
+        for (uint32_t i = 0; i + bytes_per_word <= srcsize;
+             i += bytes_per_word)
+        {
+            uint32_t data = 0;
+            for (int j = 0; j < bytes_per_word; j++)
+                data |= table[src[i + j]] << (j * byte_bits);
+            *dst++ = data;
+        }
+    }
+}
+
+// Copy a back-reference of LZ77 compressed data. The source starts distance
+// bytes before the destination, so they overlap if distance < num.
+static inline void LZ77_CopyMatch(uint8_t *out, uint32_t distance, uint32_t num)
+{
+    const uint8_t *ref = out - distance;
+
+    if (distance >= num)
+    {
+        memcpy(out, ref, num);
+    }
+    else if (distance == 1)
+    {
+        memset(out, *ref, num);
+    }
+    else
+    {
+        // The output is a repetition of the first distance bytes
+        memcpy(out, ref, distance);
+        Memory_RepeatPattern(out, distance, num);
+    }
+}
+
 // The only difference between LZ77UnCompReadNormalWrite8bit() and
 // LZ77UnCompReadNormalWrite16bit() is the width of the writes to the
 // destination. There is no difference in the emulated BIOS.
+//
+// The data is decoded straight to the destination, and back-references are
+// read from the data that has already been decoded.
 static void SWI_UncompressLZ77(const void *source, void *dest)
 {
     const uint8_t *src = source;
-    uint16_t *dst = dest;
+    uint8_t *dst = dest;
 
     // The header is 32 bits
     uint32_t header = *(uint32_t *)src;
@@ -326,61 +538,57 @@ static void SWI_UncompressLZ77(const void *source, void *dest)
 
     uint32_t size = (header >> 8) & 0x00FFFFFF;
 
-    uint8_t *buffer = malloc(size + 2);
-    if (buffer == NULL)
-    {
-        Debug_Log("%s: Not enough memory", __func__);
-        return;
-    }
+    uint8_t *out = dst;
+    uint8_t *end = dst + size;
 
-    uint8_t *buffertmp = buffer;
-    uint32_t total = 0;
-    while (size > total)
+    // Max number of bytes that a flag byte can generate: 8 back-references of
+    // 18 bytes each.
+    const uint32_t max_block_size = 8 * 18;
+
+    while (out < end)
     {
         uint8_t flag = *src++;
 
+        // If this block can't reach the end of the output, there is no need to
+        // check the size after every element.
+        int check_end = (uint32_t)(end - out) < max_block_size;
+
         for (int i = 0; i < 8; i++)
         {
             if (flag & 0x80)
             {
                 // Compressed - Copy N+3 Bytes from Dest-Disp-1 to Dest
 
-                uint16_t info = ((uint16_t)*src++) << 8;
-                info |= (uint16_t)*src++;
+                uint32_t info = ((uint32_t)src[0] << 8) | src[1];
+                src += 2;
+
+                uint32_t distance = (info & 0x0FFF) + 1;
+                uint32_t num = 3 + ((info >> 12) & 0xF);
 
-                uint32_t displacement = (info & 0x0FFF);
-                int num = 3 + ((info >> 12) & 0xF);
-                uint32_t offset = total - displacement - 1;
-                if (offset > total) // This also checks for negative values
+                if (distance > (uint32_t)(out - dst))
                 {
                     Debug_Log("%s: Error while decoding", __func__);
-                    free(buffer);
                     return;
                 }
-                while (num--)
-                {
-                    *buffertmp++ = ((uint8_t *)buffer)[offset++];
-                    total++;
-                    if (size <= total)
-                        break;
-                }
+
+                if (check_end && (num > (uint32_t)(end - out)))
+                    num = end - out;
+
+                LZ77_CopyMatch(out, distance, num);
+                out += num;
             }
             else
             {
                 // Uncompressed - Copy 1 Byte from Source to Dest
-                *buffertmp++ = *src++;
-                total++;
-                if (size <= total)
-                    break;
+                *out++ = *src++;
             }
+
+            if (check_end && (out == end))
+                break;
+
             flag <<= 1;
         }
     }
-
-    // Copy to destination
-    memcpy(dst, buffer, size);
-
-    free(buffer);
 }
 
 void SWI_LZ77UnCompReadNormalWrite8bit(const void *source, void *dest)
@@ -393,6 +601,72 @@ void SWI_LZ77UnCompReadNormalWrite16bit(const void *source, void *dest)
     SWI_UncompressLZ77(source, dest);
 }
 
+// The Huffman tree is converted to a table indexed by the next HUFF_LUT_BITS
+// bits of the bitstream. Each entry contains either the symbol and the length
+// of its code, or the node of the tree where the search has to continue for
+// codes longer than HUFF_LUT_BITS.
+
+#define HUFF_LUT_BITS   (10)
+
+typedef struct {
+    uint16_t value;     // Symbol, or offset of the node from the tree start
+    uint8_t length;     // Number of bits used by this entry
+    uint8_t is_node;    // 1 if the code is longer than HUFF_LUT_BITS
+} huff_lut_entry;
+
+static huff_lut_entry huff_lut[1 << HUFF_LUT_BITS];
+
+// Returns the address of the child of a node, and sets is_leaf if the child is
+// a data node.
+static inline const uint8_t *Huff_NodeChild(const uint8_t *node, int bit,
+                                            int *is_leaf)
+{
+    uint8_t nodeinfo = *node;
+
+    if (bit)
+        *is_leaf = nodeinfo & BIT(6);
+    else
+        *is_leaf = nodeinfo & BIT(7);
+
+    uint32_t offset = ((uint32_t)(nodeinfo & 0x3F)) * 2 + 2 + bit;
+    return (const uint8_t *)(((uintptr_t)node & ~1) + offset);
+}
+
+static void Huff_BuildLUT(const uint8_t *tree, const uint8_t *node,
+                          uint32_t code, int length)
+{
+    for (int bit = 0; bit < 2; bit++)
+    {
+        int is_leaf;
+        const uint8_t *child = Huff_NodeChild(node, bit, &is_leaf);
+
+        uint32_t child_code = (code << 1) | bit;
+        int child_length = length + 1;
+
+        if (is_leaf)
+        {
+            // Fill all entries that start with this code
+            int free_bits = HUFF_LUT_BITS - child_length;
+            uint32_t start = child_code << free_bits;
+
+            huff_lut_entry entry = { *child, child_length, 0 };
+
+            for (uint32_t i = 0; i < (1U << free_bits); i++)
+                huff_lut[start + i] = entry;
+        }
+        else if (child_length == HUFF_LUT_BITS)
+        {
+            huff_lut_entry entry = { child - tree, child_length, 1 };
+
+            huff_lut[child_code] = entry;
+        }
+        else
+        {
+            Huff_BuildLUT(tree, child, child_code, child_length);
+        }
+    }
+}
+
 void SWI_HuffUnComp(const void *source, void *dest)
 {
     const uint8_t *src = source;
@@ -406,11 +680,13 @@ void SWI_HuffUnComp(const void *source, void *dest)
     int chunk_size = header & 0xF; // In bits
     if ((chunk_size != 4) && (chunk_size != 8))
     {
-        Debug_Log("%s(): Invalid chunk size: %d", chunk_size);
+        Debug_Log("%s(): Invalid chunk size: %d", __func__, chunk_size);
         return;
     }
 
-    int size = (header >> 8) & 0x00FFFFFF;
+    uint32_t size = (header >> 8) & 0x00FFFFFF;
+    if (size == 0)
+        return;
 
     uint32_t treesize = (*src * 2) + 1;
     src++;
@@ -418,71 +694,132 @@ void SWI_HuffUnComp(const void *source, void *dest)
     const uint8_t *treetable = src;
 
     src += treesize; // Point to the bitstream
-    uint32_t *bitstream = (uint32_t *)src;
+    const uint8_t *bitstream = src;
 
-    int total = 0;
-    int bit4index = 0;
+    Huff_BuildLUT(treetable, treetable, 0, 0);
 
-    uint32_t bits = 0;
+    // The next bits of the bitstream are kept in the top bits of a 64-bit
+    // variable. New words are only read when the bits that are left aren't
+    // enough to decode the next symbol, so the bitstream is never read past
+    // the end of the data.
+    uint64_t bits = 0;
     int bitsleft = 0;
 
-    while (1)
-    {
-        const uint8_t *nodeaddr = treetable;
+    // The output is written 32 bits at a time
+    uint32_t out_word = 0;
+    int out_shift = 0;
+    uint32_t total = 0;
 
-        while (1)
-        {
-            int searching = 1;
+    int nibble_index = 0;
+    uint32_t nibble_low = 0;
 
-            if (bitsleft == 0)
-            {
-                bits = *bitstream++;
-                bitsleft = 32;
-            }
-            int node = bits >> 31; // Get bit 31
+    while (total < size)
+    {
+        huff_lut_entry entry = huff_lut[bits >> (64 - HUFF_LUT_BITS)];
 
-            bits <<= 1;
-            bitsleft--;
+        if (entry.length > bitsleft)
+        {
+            uint32_t word;
+            memcpy(&word, bitstream, sizeof(word));
+            bitstream += 4;
 
-            uint8_t nodeinfo = *nodeaddr;
-            if ((node == 1) && (nodeinfo & BIT(6)))
-                searching = 0;
-            if ((node == 0) && (nodeinfo & BIT(7)))
-                searching = 0;
+            bits |= (uint64_t)word << (32 - bitsleft);
+            bitsleft += 32;
+            continue;
+        }
 
-            uint32_t offset = ((uint32_t)(nodeinfo & 0x3F)) * 2 + 2 + node;
-            nodeaddr = (const uint8_t *)(((uintptr_t)nodeaddr & ~1) + offset);
+        bits <<= entry.length;
+        bitsleft -= entry.length;
 
-            if (searching == 0)
-                break;
-        }
+        uint32_t symbol;
 
-        if (chunk_size == 8)
+        if (entry.is_node == 0)
         {
-            *dst++ = *nodeaddr;
-            total++;
+            symbol = entry.value;
         }
-        else // if (chunk_size == 4)
+        else
         {
-            if (bit4index & 1)
+            // Long code. Continue walking the tree one bit at a time.
+
+            const uint8_t *nodeaddr = treetable + entry.value;
+
+            while (1)
             {
-                *dst |= (*nodeaddr) << 4;
-                dst++;
-                total++;
+                if (bitsleft == 0)
+                {
+                    uint32_t word;
+                    memcpy(&word, bitstream, sizeof(word));
+                    bitstream += 4;
+
+                    bits = (uint64_t)word << 32;
+                    bitsleft = 32;
+                }
+
+                int bit = bits >> 63;
+                bits <<= 1;
+                bitsleft--;
+
+                int is_leaf;
+                nodeaddr = Huff_NodeChild(nodeaddr, bit, &is_leaf);
+                if (is_leaf)
+                    break;
             }
-            else
+
+            symbol = *nodeaddr;
+        }
+
+        if (chunk_size == 4)
+        {
+            nibble_index ^= 1;
+            if (nibble_index)
             {
-                *dst = *nodeaddr;
+                nibble_low = symbol;
+                continue;
             }
-            bit4index ^= 1;
+
+            symbol = (uint8_t)(nibble_low | (symbol << 4));
+        }
+
+        out_word |= symbol << out_shift;
+        out_shift += 8;
+        total++;
+
+        if (out_shift == 32)
+        {
+            memcpy(dst, &out_word, sizeof(out_word));
+            dst += 4;
+            out_word = 0;
+            out_shift = 0;
         }
+    }
+
+    // Write the bytes that don't fill a whole word
+    while (out_shift > 0)
+    {
+        *dst++ = out_word & 0xFF;
+        out_word >>= 8;
+        out_shift -= 8;
+    }
+}
+
+// The WRAM and VRAM versions of the decoders only differ in the width of the
+// writes to the destination (8 or 16 bits). The emulated BIOS writes to host
+// memory, so the output is the same. The width is only used to warn about
+// arguments that wouldn't work in real hardware.
+static void GBA_CheckWriteWidth(const char *caller, const void *dest,
+                                uint32_t size, int write_width)
+{
+    if (write_width != 2)
+        return;
 
-        if (total >= size)
-            break;
+    if (((uintptr_t)dest & 1) || (size & 1))
+    {
+        Debug_Log("%s: 16-bit writes need an aligned destination and an even "
+                  "size", caller);
     }
 }
 
-static void GBA_SWI_RLUnComp(const void *source, void *dest)
+static void GBA_SWI_RLUnComp(const void *source, void *dest, int write_width)
 {
     const uint8_t *src = source;
     uint8_t *dst = dest;
@@ -493,54 +830,109 @@ static void GBA_SWI_RLUnComp(const void *source, void *dest)
 
     // TODO: Check extra fields in header
 
-    int32_t size = (header >> 8) & 0x00FFFFFF;
+    uint32_t size = (header >> 8) & 0x00FFFFFF;
+
+    GBA_CheckWriteWidth(__func__, dest, size, write_width);
 
     while (size > 0)
     {
         uint8_t flag = *src++;
+        uint32_t len;
 
         if (flag & BIT(7)) // Compressed - 1 byte repeated N times
         {
-            int32_t len = (flag & 0x7F) + 3;
-            uint8_t data = *src++;
+            len = (flag & 0x7F) + 3;
+            if (len > size)
+                len = size;
 
-            while (len)
-            {
-                *dst++ = data;
-                size--;
-                len--;
-            }
+            memset(dst, *src++, len);
         }
         else // N uncompressed bytes
         {
-            int32_t len = (flag & 0x7F) + 1;
+            len = (flag & 0x7F) + 1;
+            if (len > size)
+                len = size;
 
-            while (len)
-            {
-                *dst++ = *src++;
-                size--;
-                len--;
-            }
+            memcpy(dst, src, len);
+            src += len;
         }
+
+        dst += len;
+        size -= len;
     }
 }
 
 void SWI_RLUnCompWram(const void *source, void *dest)
 {
-    // TODO: Check alignment of arguments
-
-    GBA_SWI_RLUnComp(source, dest);
+    GBA_SWI_RLUnComp(source, dest, 1);
 }
 
 void SWI_RLUnCompVram(const void *source, void *dest)
 {
-    // TODO: Check alignment of arguments
-    // TODO: Can the size be not a multiple of 2?
+    GBA_SWI_RLUnComp(source, dest, 2);
+}
+
+// Prefix sum of 8-bit values, 16 at a time. It returns the number of values
+// that have been handled, and it updates the last value of the sum.
+static uint32_t GBA_Diff8bitUnFilter_Vector(const uint8_t *src, uint8_t *dst,
+                                            uint32_t count, uint8_t *value)
+{
+#if defined(UGBA_SSE2)
+    uint32_t i;
+    uint8_t last = *value;
+
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)&src[i]);
+
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi8(x, _mm_set1_epi8((char)last));
+
+        _mm_storeu_si128((__m128i *)&dst[i], x);
+
+        last = _mm_extract_epi16(x, 7) >> 8;
+    }
+
+    *value = last;
+    return i;
+#elif defined(UGBA_NEON)
+    const uint8x16_t zero = vdupq_n_u8(0);
+
+    uint32_t i;
+    uint8_t last = *value;
+
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        uint8x16_t x = vld1q_u8(&src[i]);
+
+        x = vaddq_u8(x, vextq_u8(zero, x, 15));
+        x = vaddq_u8(x, vextq_u8(zero, x, 14));
+        x = vaddq_u8(x, vextq_u8(zero, x, 12));
+        x = vaddq_u8(x, vextq_u8(zero, x, 8));
+        x = vaddq_u8(x, vdupq_n_u8(last));
+
+        vst1q_u8(&dst[i], x);
 
-    GBA_SWI_RLUnComp(source, dest);
+        last = vgetq_lane_u8(x, 15);
+    }
+
+    *value = last;
+    return i;
+#else
+    (void)src;
+    (void)dst;
+    (void)count;
+    (void)value;
+
+    return 0;
+#endif
 }
 
-static void GBA_Diff8bitUnFilter(const void *source, void *dest)
+static void GBA_Diff8bitUnFilter(const void *source, void *dest,
+                                 int write_width)
 {
     const uint8_t *src = source;
     uint8_t *dst = dest;
@@ -551,37 +943,91 @@ static void GBA_Diff8bitUnFilter(const void *source, void *dest)
 
     // TODO: Check extra fields in header
 
-    int32_t size = (header >> 8) & 0x00FFFFFF;
+    uint32_t size = (header >> 8) & 0x00FFFFFF;
+
+    GBA_CheckWriteWidth(__func__, dest, size, write_width);
 
     uint8_t value = 0;
 
-    while (size > 0)
+    uint32_t i = GBA_Diff8bitUnFilter_Vector(src, dst, size, &value);
+
+    for ( ; i < size; i++)
     {
-        value += *src++;
-        *dst++ = value;
-        size--;
+        value += src[i];
+        dst[i] = value;
     }
 }
 
 void SWI_Diff8bitUnFilterWram(const void *source, void *dest)
 {
-    // TODO: Check alignment of arguments
-
-    GBA_Diff8bitUnFilter(source, dest);
+    GBA_Diff8bitUnFilter(source, dest, 1);
 }
 
 void SWI_Diff8bitUnFilterVram(const void *source, void *dest)
 {
-    // TODO: Check alignment of arguments
-    // TODO: Can the size be not a multiple of 2?
+    GBA_Diff8bitUnFilter(source, dest, 2);
+}
+
+// Prefix sum of 16-bit values, 8 at a time. It returns the number of values
+// that have been handled, and it updates the last value of the sum.
+static uint32_t GBA_Diff16bitUnFilter_Vector(const uint16_t *src,
+                                             uint16_t *dst, uint32_t count,
+                                             uint16_t *value)
+{
+#if defined(UGBA_SSE2)
+    uint32_t i;
+    uint16_t last = *value;
+
+    for (i = 0; i + 8 <= count; i += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)&src[i]);
+
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi16(x, _mm_set1_epi16((short)last));
+
+        _mm_storeu_si128((__m128i *)&dst[i], x);
+
+        last = _mm_extract_epi16(x, 7);
+    }
+
+    *value = last;
+    return i;
+#elif defined(UGBA_NEON)
+    const uint16x8_t zero = vdupq_n_u16(0);
+
+    uint32_t i;
+    uint16_t last = *value;
+
+    for (i = 0; i + 8 <= count; i += 8)
+    {
+        uint16x8_t x = vld1q_u16(&src[i]);
+
+        x = vaddq_u16(x, vextq_u16(zero, x, 7));
+        x = vaddq_u16(x, vextq_u16(zero, x, 6));
+        x = vaddq_u16(x, vextq_u16(zero, x, 4));
+        x = vaddq_u16(x, vdupq_n_u16(last));
+
+        vst1q_u16(&dst[i], x);
+
+        last = vgetq_lane_u16(x, 7);
+    }
+
+    *value = last;
+    return i;
+#else
+    (void)src;
+    (void)dst;
+    (void)count;
+    (void)value;
 
-    GBA_Diff8bitUnFilter(source, dest);
+    return 0;
+#endif
 }
 
 void SWI_Diff16bitUnFilter(const void *source, void *dest)
 {
-    // TODO: Check alignment of arguments
-
     const uint16_t *src = source;
     uint16_t *dst = dest;
 
@@ -591,14 +1037,20 @@ void SWI_Diff16bitUnFilter(const void *source, void *dest)
 
     // TODO: Check extra fields in header
 
-    int32_t size = (header >> 8) & 0x00FFFFFF;
+    uint32_t size = (header >> 8) & 0x00FFFFFF;
+
+    GBA_CheckWriteWidth(__func__, dest, size, 2);
+
+    // The size is in bytes
+    uint32_t count = (size + 1) / 2;
 
     uint16_t value = 0;
 
-    while (size > 0)
+    uint32_t i = GBA_Diff16bitUnFilter_Vector(src, dst, count, &value);
+
+    for ( ; i < count; i++)
     {
-        value += *src++;
-        *dst++ = value;
-        size -= 2;
+        value += src[i];
+        dst[i] = value;
     }
 }
@@ -6,6 +6,8 @@
 
 #include <ugba/ugba.h>
 
+#include "dma.h"
+
 #include "../debug_utils.h"
 
 typedef struct {
@@ -21,11 +23,31 @@ typedef struct {
     int repeat;
 
     uint32_t start_mode;
+
+    // Transfer plan, prepared when the transfer is set up: the fast path that
+    // can be used and the number of bytes to copy.
+    dma_copy_kind kind;
+    size_t size;
+
+    dma_channel_stats stats;
 } dma_channel;
 
 static dma_channel DMA[4];
 
-static void GBA_DMACopyNow(dma_channel *dma)
+// List of channels that are waiting for a HBL or VBL event, sorted by priority.
+// They are updated every time the state of a channel changes so that the HBL
+// and VBL handlers don't need to check the state of all channels.
+typedef struct {
+    int channel[4];
+    int count;
+} dma_active_list;
+
+static dma_active_list DMA_HBL_Active;
+static dma_active_list DMA_VBL_Active;
+
+// Copy one unit at a time. This is how the hardware works, and it is needed
+// for transfers with decrementing addresses and for overlapping transfers.
+static void GBA_DMACopyGeneric(dma_channel *dma)
 {
     if (dma->copywords)
     {
@@ -55,69 +77,209 @@ static void GBA_DMACopyNow(dma_channel *dma)
     }
 }
 
-static int UGBA_DMA_SoundGetChannelFifoA(void)
+// Both addresses increment. This is equivalent to memmove() unless the
+// destination starts inside the source region, in which case the hardware
+// replicates the start of the source.
+static int GBA_DMACopyMemmove(dma_channel *dma)
 {
-    if (DMA[1].dstaddr == (uintptr_t)REG_FIFO_A)
+    size_t size = dma->size;
+
+    if ((dma->dstaddr > dma->srcaddr) && (dma->dstaddr < dma->srcaddr + size))
+        return -1;
+
+    memmove((void *)dma->dstaddr, (const void *)dma->srcaddr, size);
+
+    return 0;
+}
+
+// Fixed source and incrementing destination. The source is only read once, so
+// the destination must not overwrite it in the middle of the transfer.
+static int GBA_DMACopyFill(dma_channel *dma)
+{
+    size_t size = dma->size;
+
+    if ((dma->srcaddr >= dma->dstaddr) && (dma->srcaddr < dma->dstaddr + size))
+        return -1;
+
+    if (dma->copywords)
     {
-        if (DMA[1].start_mode == DMACNT_START_SPECIAL)
-        {
-            return 1;
-        }
-    }
+        uint32_t value = *(uint32_t *)dma->srcaddr;
+        uint32_t *dst = (uint32_t *)dma->dstaddr;
 
-    if (DMA[2].dstaddr == (uintptr_t)REG_FIFO_A)
+        for (size_t i = 0; i < dma->num_chunks; i++)
+            dst[i] = value;
+    }
+    else
     {
-        if (DMA[2].start_mode == DMACNT_START_SPECIAL)
-        {
-            return 2;
-        }
+        uint16_t value = *(uint16_t *)dma->srcaddr;
+        uint16_t *dst = (uint16_t *)dma->dstaddr;
+
+        for (size_t i = 0; i < dma->num_chunks; i++)
+            dst[i] = value;
     }
 
-    return -1;
+    return 0;
+}
+
+// Fixed destination (like a FIFO). Only the last value written stays in the
+// destination, so there is no need to write all the previous ones.
+static int GBA_DMACopyLast(dma_channel *dma)
+{
+    uintptr_t unit = dma->copywords ? 4 : 2;
+
+    intptr_t last_offset = (intptr_t)dma->srcadd
+                         * (intptr_t)(dma->num_chunks - 1);
+    uintptr_t last_src = dma->srcaddr + last_offset;
+
+    uintptr_t start = (last_offset < 0) ? last_src : dma->srcaddr;
+    uintptr_t end = ((last_offset < 0) ? dma->srcaddr : last_src) + unit;
+
+    // If the destination is one of the source values, the result depends on
+    // the order of the writes.
+    if ((dma->dstaddr + unit > start) && (dma->dstaddr < end))
+        return -1;
+
+    if (dma->copywords)
+        *(uint32_t *)dma->dstaddr = *(uint32_t *)last_src;
+    else
+        *(uint16_t *)dma->dstaddr = *(uint16_t *)last_src;
+
+    return 0;
 }
 
-static int UGBA_DMA_SoundGetChannelFifoB(void)
+static void GBA_DMACopyNow(dma_channel *dma)
 {
-    if (DMA[1].dstaddr == (uintptr_t)REG_FIFO_B)
+    dma_copy_kind kind = dma->kind;
+    int ret = -1;
+
+    switch (kind)
     {
-        if (DMA[1].start_mode == DMACNT_START_SPECIAL)
-        {
-            return 1;
-        }
+        case DMA_COPY_MEMMOVE:
+            ret = GBA_DMACopyMemmove(dma);
+            break;
+        case DMA_COPY_FILL:
+            ret = GBA_DMACopyFill(dma);
+            break;
+        case DMA_COPY_LAST:
+            ret = GBA_DMACopyLast(dma);
+            break;
+        case DMA_COPY_GENERIC:
+        case DMA_COPY_KIND_NUMBER:
+            break;
     }
 
-    if (DMA[2].dstaddr == (uintptr_t)REG_FIFO_B)
+    if (ret == 0)
     {
-        if (DMA[2].start_mode == DMACNT_START_SPECIAL)
-        {
-            return 2;
-        }
+        // The fast paths don't update the addresses while copying
+        dma->srcaddr += (intptr_t)dma->srcadd * (intptr_t)dma->num_chunks;
+        dma->dstaddr += (intptr_t)dma->dstadd * (intptr_t)dma->num_chunks;
+    }
+    else
+    {
+        kind = DMA_COPY_GENERIC;
+        GBA_DMACopyGeneric(dma);
     }
 
-    return -1;
+    dma->stats.transfers[kind]++;
+    dma->stats.bytes[kind] += dma->size;
+}
+
+// Decide which fast path can be used for a transfer, based on the increment
+// modes of the source and destination addresses.
+static dma_copy_kind GBA_DMAClassify(const dma_channel *dma)
+{
+    int32_t unit = dma->copywords ? 4 : 2;
+
+    if (dma->dstadd == 0)
+        return DMA_COPY_LAST;
+
+    if (dma->dstadd != unit)
+        return DMA_COPY_GENERIC;
+
+    if (dma->srcadd == unit)
+        return DMA_COPY_MEMMOVE;
+
+    if (dma->srcadd == 0)
+        return DMA_COPY_FILL;
+
+    return DMA_COPY_GENERIC;
+}
+
+const dma_channel_stats *GBA_DMAGetStats(int channel)
+{
+    if ((channel < 0) || (channel > 3))
+        return NULL;
+
+    return &DMA[channel].stats;
+}
+
+void GBA_DMAResetStats(void)
+{
+    for (int i = 0; i < 4; i++)
+        memset(&DMA[i].stats, 0, sizeof(DMA[i].stats));
+}
+
+// Sound FIFO streams
+// ==================
+//
+// Channels 1 and 2 can stream data to the sound FIFOs. The channel bound to
+// each FIFO is resolved when the DMA registers are written, so that the sound
+// mixer doesn't need to check the state of the channels for every read.
+
+// FIFO A: fifo = 0 | FIFO B: fifo = 1. NULL if no channel is bound.
+static dma_channel *DMA_FIFO_Stream[2];
+
+static dma_channel *GBA_DMAFindFifoChannel(uintptr_t fifo_addr)
+{
+    for (int i = 1; i <= 2; i++)
+    {
+        dma_channel *dma = &DMA[i];
+
+        if (dma->dstaddr != fifo_addr)
+            continue;
+
+        if (dma->start_mode == DMACNT_START_SPECIAL)
+            return dma;
+    }
+
+    return NULL;
+}
+
+static void GBA_DMAUpdateFifoStreams(void)
+{
+    DMA_FIFO_Stream[0] = GBA_DMAFindFifoChannel((uintptr_t)REG_FIFO_A);
+    DMA_FIFO_Stream[1] = GBA_DMAFindFifoChannel((uintptr_t)REG_FIFO_B);
+}
+
+const uint32_t *UGBA_DMA_SoundReadFifo(int fifo, size_t words)
+{
+    dma_channel *dma = DMA_FIFO_Stream[fifo];
+    if (dma == NULL)
+        return NULL;
+
+    // The word count of the channel is ignored in sound FIFO mode, the stream
+    // only ends when the channel is stopped.
+    const uint32_t *src = (const uint32_t *)dma->srcaddr;
+    dma->srcaddr += words * sizeof(uint32_t);
+
+    return src;
 }
 
 uint32_t UGBA_DMA_SoundGetDataFifoA(void)
 {
-    int channel = UGBA_DMA_SoundGetChannelFifoA();
-    if (channel == -1)
+    const uint32_t *src = UGBA_DMA_SoundReadFifo(0, 1);
+    if (src == NULL)
         return 0;
 
-    uint32_t *src = (uint32_t *)DMA[channel].srcaddr;
-    DMA[channel].srcaddr += 4;
-
     return *src;
 }
 
 uint32_t UGBA_DMA_SoundGetDataFifoB(void)
 {
-    int channel = UGBA_DMA_SoundGetChannelFifoB();
-    if (channel == -1)
+    const uint32_t *src = UGBA_DMA_SoundReadFifo(1, 1);
+    if (src == NULL)
         return 0;
 
-    uint32_t *src = (uint32_t *)DMA[channel].srcaddr;
-    DMA[channel].srcaddr += 4;
-
     return *src;
 }
 
@@ -216,6 +378,9 @@ static void GBA_DMAUpdateState(int channel)
 
     dma->start_mode = dmacnt & (3 << 12);
 
+    dma->kind = GBA_DMAClassify(dma);
+    dma->size = dma->num_chunks * (dma->copywords ? 4 : 2);
+
     if (dma->start_mode == DMACNT_START_NOW)
     {
         // Do the copy now
@@ -231,6 +396,27 @@ static void GBA_DMAUpdateState(int channel)
     }
 }
 
+static void GBA_DMAUpdateActiveChannels(void)
+{
+    DMA_HBL_Active.count = 0;
+    DMA_VBL_Active.count = 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        dma_channel *dma = &DMA[i];
+
+        if (dma->enabled == 0)
+            continue;
+
+        if (dma->start_mode == DMACNT_START_HBLANK)
+            DMA_HBL_Active.channel[DMA_HBL_Active.count++] = i;
+        else if (dma->start_mode == DMACNT_START_VBLANK)
+            DMA_VBL_Active.channel[DMA_VBL_Active.count++] = i;
+    }
+
+    GBA_DMAUpdateFifoStreams();
+}
+
 void GBA_DMAUpdateRegister(uint32_t offset)
 {
     switch (offset)
@@ -249,8 +435,10 @@ void GBA_DMAUpdateRegister(uint32_t offset)
             break;
 
         default:
-            break;
+            return;
     }
+
+    GBA_DMAUpdateActiveChannels();
 }
 
 static void GBA_DMAStop(int channel)
@@ -268,42 +456,40 @@ static void GBA_DMAStop(int channel)
         REG_DMA2CNT_H &= ~DMACNT_DMA_ENABLE;
     else if (channel == 3)
         REG_DMA3CNT_H &= ~DMACNT_DMA_ENABLE;
+
+    GBA_DMAUpdateActiveChannels();
 }
 
-void GBA_DMAHandleHBL(void)
+static void GBA_DMAHandleActiveList(const dma_active_list *list)
 {
-    for (int i = 0; i < 4; i++)
-    {
-        dma_channel *dma = &DMA[i];
-
-        if (dma->enabled == 0)
-            continue;
+    // Channels that don't repeat are removed from the list as soon as they are
+    // stopped, so iterate over a copy of the list.
+    dma_active_list active = *list;
 
-        if (dma->start_mode != DMACNT_START_HBLANK)
-            continue;
+    for (int i = 0; i < active.count; i++)
+    {
+        int channel = active.channel[i];
+        dma_channel *dma = &DMA[channel];
 
         GBA_DMACopyNow(dma);
 
         if (dma->repeat == 0)
-            GBA_DMAStop(i);
+            GBA_DMAStop(channel);
     }
 }
 
-void GBA_DMAHandleVBL(void)
+void GBA_DMAHandleHBL(void)
 {
-    for (int i = 0; i < 4; i++)
-    {
-        dma_channel *dma = &DMA[i];
-
-        if (dma->enabled == 0)
-            continue;
+    if (DMA_HBL_Active.count == 0)
+        return;
 
-        if (dma->start_mode != DMACNT_START_VBLANK)
-            continue;
+    GBA_DMAHandleActiveList(&DMA_HBL_Active);
+}
 
-        GBA_DMACopyNow(dma);
+void GBA_DMAHandleVBL(void)
+{
+    if (DMA_VBL_Active.count == 0)
+        return;
 
-        if (dma->repeat == 0)
-            GBA_DMAStop(i);
-    }
+    GBA_DMAHandleActiveList(&DMA_VBL_Active);
 }
@@ -5,6 +5,27 @@
 #ifndef SDL2_CORE_DMA_H__
 #define SDL2_CORE_DMA_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
+// Kind of copy used by a DMA transfer. All of them except for the generic one
+// are fast paths selected when the transfer starts.
+typedef enum {
+    DMA_COPY_MEMMOVE,   // Incrementing source and destination
+    DMA_COPY_FILL,      // Fixed source, incrementing destination
+    DMA_COPY_LAST,      // Fixed destination, only the last value is written
+    DMA_COPY_GENERIC,   // One unit at a time (decrementing or overlapping)
+
+    DMA_COPY_KIND_NUMBER
+} dma_copy_kind;
+
+// Number of transfers done by a DMA channel and bytes moved by them, split by
+// the kind of copy used.
+typedef struct {
+    uint64_t transfers[DMA_COPY_KIND_NUMBER];
+    uint64_t bytes[DMA_COPY_KIND_NUMBER];
+} dma_channel_stats;
+
 void GBA_DMAUpdateRegister(uint32_t offset);
 void GBA_DMAHandleHBL(void);
 void GBA_DMAHandleVBL(void);
@@ -12,4 +33,13 @@ void GBA_DMAHandleVBL(void);
 uint32_t UGBA_DMA_SoundGetDataFifoA(void);
 uint32_t UGBA_DMA_SoundGetDataFifoB(void);
 
+// FIFO A: fifo = 0 | FIFO B: fifo = 1. Returns a pointer to the next block of
+// data that the DMA channel bound to that FIFO sends, and advances the stream
+// by the specified number of 32-bit words. Returns NULL if no channel is bound.
+const uint32_t *UGBA_DMA_SoundReadFifo(int fifo, size_t words);
+
+// Returns NULL if the channel isn't valid
+const dma_channel_stats *GBA_DMAGetStats(int channel);
+void GBA_DMAResetStats(void);
+
 #endif // SDL2_CORE_DMA_H__
@@ -1,14 +1,18 @@
 // SPDX-License-Identifier: LGPL-3.0-only
 //
-// Copyright (c) 2020 Antonio Niño Díaz
+// Copyright (c) 2020-2021 Antonio Niño Díaz
+
+#include <string.h>
 
 #include <ugba/ugba.h>
 
 #include "dma.h"
+#include "sound.h"
+#include "sound_psg.h"
 
 #include "../debug_utils.h"
+#include "../simd.h"
 #include "../sound_utils.h"
-#include "../wav_utils.h"
 
 // The simulation always runs at 60 FPS, but the GBA runs at a slightly
 // different rate.
@@ -94,8 +98,32 @@ static void Sound_FillBuffers_VBL_DMA(int dma_channel)
 
     sound_dma_info_t *dma = &sound_dma[dma_channel];
 
-    for (uint32_t i = 0; i < GBA_CLOCKS_PER_FRAME; i++)
+    // Instead of simulating every clock of the frame, jump straight to the
+    // next clock in which a new sample is read from the FIFO or a sample is
+    // written to the output buffer. The counters are kept between frames, so
+    // the fractional part of a sample period is carried to the next frame.
+
+    uint32_t remaining = GBA_CLOCKS_PER_FRAME;
+
+    while (remaining > 0)
     {
+        uint32_t step = dma->clocks_current_sample;
+        if (step > (uint32_t)dma->clocks_current_buffer_index)
+            step = dma->clocks_current_buffer_index;
+
+        if (step >= remaining)
+        {
+            dma->clocks_current_sample -= remaining;
+            dma->clocks_current_buffer_index -= remaining;
+            break;
+        }
+
+        dma->clocks_current_sample -= step;
+        dma->clocks_current_buffer_index -= step;
+        remaining -= step;
+
+        // At least one of the counters has reached zero in this clock
+
         if (dma->clocks_current_sample == 0)
         {
             dma->clocks_current_sample = clocks_per_period;
@@ -133,30 +161,129 @@ static void Sound_FillBuffers_VBL_DMA(int dma_channel)
         }
 
         dma->clocks_current_buffer_index--;
+        remaining--;
     }
 }
 
+// Number of times that a counter reaches zero in the given number of clocks.
+// The counter is reloaded with "period" every time that happens. The counter
+// is updated with its value after the clocks have elapsed.
+static uint32_t Sound_CounterEvents(int *counter, uint32_t period,
+                                    uint32_t clocks)
+{
+    uint32_t start = *counter;
+
+    if (start >= clocks)
+    {
+        *counter = start - clocks;
+        return 0;
+    }
+
+    uint32_t events = ((clocks - 1 - start) / period) + 1;
+    uint32_t last = start + (events - 1) * period;
+
+    *counter = last + period - clocks;
+
+    return events;
+}
+
 // DMA A: dma_channel = 0 | DMA B: dma_channel = 1
-static int Sound_BufferIsEmpty_DMA(int dma_channel)
+//
+// Equivalent to Sound_FillBuffers_VBL_DMA(), but the samples aren't saved in
+// the buffer. The state of the FIFO and the DMA source address are updated as
+// if the samples had been generated. Returns the number of samples that would
+// have been written to the buffer.
+static uint32_t Sound_SkipBuffers_VBL_DMA(int dma_channel)
 {
+    int timer;
+
+    if (dma_channel == 0)
+        timer = REG_SOUNDCNT_H & SOUNDCNT_H_DMA_A_TIMER1;
+    else
+        timer = REG_SOUNDCNT_H & SOUNDCNT_H_DMA_B_TIMER1;
+
+    uint32_t clocks_per_period = UGBA_TimerClocksPerPeriod(timer);
+
     sound_dma_info_t *dma = &sound_dma[dma_channel];
 
-    if (dma->write_ptr == dma->read_ptr)
-        return 1;
+    uint32_t fetches = Sound_CounterEvents(&dma->clocks_current_sample,
+                                           clocks_per_period,
+                                           GBA_CLOCKS_PER_FRAME);
 
-    return 0;
+    uint32_t writes = Sound_CounterEvents(&dma->clocks_current_buffer_index,
+                                          GBA_CLOCKS_PER_SAMPLE_60_FPS,
+                                          GBA_CLOCKS_PER_FRAME);
+
+    // Nobody reads the buffer
+    dma->read_ptr = dma->write_ptr;
+
+    if (fetches == 0)
+        return writes;
+
+    if (fetches <= (uint32_t)dma->sample_count)
+    {
+        // All samples come from the last word read from the FIFO
+        dma->sample_data >>= 8 * (fetches - 1);
+        dma->current_sample = dma->sample_data & 0xFF;
+        dma->sample_data >>= 8;
+        dma->sample_count -= fetches;
+        return writes;
+    }
+
+    // Read all the words needed at once and keep the last one
+
+    uint32_t needed = fetches - dma->sample_count;
+    uint32_t words = (needed + 3) / 4;
+
+    const uint32_t *src = UGBA_DMA_SoundReadFifo(dma_channel, words);
+    uint32_t data = (src == NULL) ? 0 : src[words - 1];
+
+    // Samples of the last word that have been used
+    uint32_t used = needed - (words - 1) * 4;
+
+    data >>= 8 * (used - 1);
+    dma->current_sample = data & 0xFF;
+    dma->sample_data = data >> 8;
+    dma->sample_count = 4 - used;
+
+    return writes;
 }
 
 // DMA A: dma_channel = 0 | DMA B: dma_channel = 1
-static int8_t Sound_GetSample_DMA(int dma_channel)
+static int Sound_BufferAvailable_DMA(int dma_channel)
 {
     sound_dma_info_t *dma = &sound_dma[dma_channel];
 
-    int8_t sample = dma->buffer[dma->read_ptr];
-    dma->read_ptr++;
-    dma->read_ptr %= GBA_SAMPLES_PER_FRAME;
+    int available = dma->write_ptr - dma->read_ptr;
+    if (available < 0)
+        available += GBA_SAMPLES_PER_FRAME;
 
-    return sample;
+    return available;
+}
+
+// DMA A: dma_channel = 0 | DMA B: dma_channel = 1
+static void Sound_ReadBlock_DMA(int dma_channel, int16_t *dst, int samples)
+{
+    sound_dma_info_t *dma = &sound_dma[dma_channel];
+
+    // The data may wrap around the end of the buffer, so copy it in up to two
+    // contiguous blocks.
+    while (samples > 0)
+    {
+        int count = GBA_SAMPLES_PER_FRAME - dma->read_ptr;
+        if (count > samples)
+            count = samples;
+
+        const int8_t *src = &dma->buffer[dma->read_ptr];
+        for (int i = 0; i < count; i++)
+            dst[i] = src[i];
+
+        dst += count;
+        samples -= count;
+
+        dma->read_ptr += count;
+        dma->read_ptr %= GBA_SAMPLES_PER_FRAME;
+    }
 }
 
 // Sound mixer
@@ -171,6 +298,152 @@ typedef struct {
 
 static mixed_sound_info_t mixed;
 
+// Volume applied to the final output, Q15. Values of 0x8000 or more mean that
+// the volume isn't changed.
+#define MASTER_VOLUME_MAX       (0x8000)
+
+static int32_t master_volume = MASTER_VOLUME_MAX;
+
+static int16_t dma_a_block[GBA_SAMPLES_PER_FRAME];
+static int16_t dma_b_block[GBA_SAMPLES_PER_FRAME];
+
+static int16_t psg_left[GBA_SAMPLES_PER_FRAME];
+static int16_t psg_right[GBA_SAMPLES_PER_FRAME];
+
+typedef struct {
+    int16_t dma_a_left, dma_a_right;
+    int16_t dma_b_left, dma_b_right;
+    int16_t master; // Q15, only used if apply_master is 1
+    int apply_master;
+} mix_gains_t;
+
+static inline int16_t Sound_Saturate(int32_t value)
+{
+    if (value > INT16_MAX)
+        return INT16_MAX;
+    if (value < INT16_MIN)
+        return INT16_MIN;
+    return (int16_t)value;
+}
+
+// Mix one sample of one side. This does exactly the same operations as the
+// vector versions below, in the same order.
+static inline int16_t Sound_MixSample(int16_t a, int16_t b, int16_t psg,
+                                      int16_t gain_a, int16_t gain_b,
+                                      const mix_gains_t *g)
+{
+    // The products of the DMA samples and gains always fit in 16 bits
+    int16_t value = Sound_Saturate((int16_t)(a * gain_a) +
+                                   (int16_t)(b * gain_b));
+    value = Sound_Saturate(value + psg);
+
+    if (g->apply_master)
+        value = (int16_t)(((int32_t)value * g->master) >> 15);
+
+    return value;
+}
+
+// Mix the DMA and PSG blocks and write the interleaved stereo result. Returns
+// the number of samples that have been mixed (all of them unless there is no
+// vector version available).
+static int Sound_MixBlock_Vector(int16_t *out, int samples,
+                                 const mix_gains_t *g)
+{
+#if defined(UGBA_SSE2)
+    const __m128i gain_a_l = _mm_set1_epi16(g->dma_a_left);
+    const __m128i gain_a_r = _mm_set1_epi16(g->dma_a_right);
+    const __m128i gain_b_l = _mm_set1_epi16(g->dma_b_left);
+    const __m128i gain_b_r = _mm_set1_epi16(g->dma_b_right);
+    const __m128i master = _mm_set1_epi16(g->master);
+
+    int i;
+
+    for (i = 0; i + 8 <= samples; i += 8)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)&dma_a_block[i]);
+        __m128i b = _mm_loadu_si128((const __m128i *)&dma_b_block[i]);
+        __m128i pl = _mm_loadu_si128((const __m128i *)&psg_left[i]);
+        __m128i pr = _mm_loadu_si128((const __m128i *)&psg_right[i]);
+
+        __m128i l = _mm_adds_epi16(_mm_mullo_epi16(a, gain_a_l),
+                                   _mm_mullo_epi16(b, gain_b_l));
+        __m128i r = _mm_adds_epi16(_mm_mullo_epi16(a, gain_a_r),
+                                   _mm_mullo_epi16(b, gain_b_r));
+
+        l = _mm_adds_epi16(l, pl);
+        r = _mm_adds_epi16(r, pr);
+
+        if (g->apply_master)
+        {
+            // (x * master) >> 15 from the high and low halves of the product
+            l = _mm_or_si128(_mm_slli_epi16(_mm_mulhi_epi16(l, master), 1),
+                             _mm_srli_epi16(_mm_mullo_epi16(l, master), 15));
+            r = _mm_or_si128(_mm_slli_epi16(_mm_mulhi_epi16(r, master), 1),
+                             _mm_srli_epi16(_mm_mullo_epi16(r, master), 15));
+        }
+
+        _mm_storeu_si128((__m128i *)&out[i * 2], _mm_unpacklo_epi16(l, r));
+        _mm_storeu_si128((__m128i *)&out[i * 2 + 8], _mm_unpackhi_epi16(l, r));
+    }
+
+    return i;
+#elif defined(UGBA_NEON)
+    const int16x8_t gain_a_l = vdupq_n_s16(g->dma_a_left);
+    const int16x8_t gain_a_r = vdupq_n_s16(g->dma_a_right);
+    const int16x8_t gain_b_l = vdupq_n_s16(g->dma_b_left);
+    const int16x8_t gain_b_r = vdupq_n_s16(g->dma_b_right);
+    const int16x8_t master = vdupq_n_s16(g->master);
+
+    int i;
+
+    for (i = 0; i + 8 <= samples; i += 8)
+    {
+        int16x8_t a = vld1q_s16(&dma_a_block[i]);
+        int16x8_t b = vld1q_s16(&dma_b_block[i]);
+
+        int16x8x2_t lr;
+
+        lr.val[0] = vqaddq_s16(vmulq_s16(a, gain_a_l), vmulq_s16(b, gain_b_l));
+        lr.val[1] = vqaddq_s16(vmulq_s16(a, gain_a_r), vmulq_s16(b, gain_b_r));
+
+        lr.val[0] = vqaddq_s16(lr.val[0], vld1q_s16(&psg_left[i]));
+        lr.val[1] = vqaddq_s16(lr.val[1], vld1q_s16(&psg_right[i]));
+
+        if (g->apply_master)
+        {
+            // (2 * x * master) >> 16
+            lr.val[0] = vqdmulhq_s16(lr.val[0], master);
+            lr.val[1] = vqdmulhq_s16(lr.val[1], master);
+        }
+
+        vst2q_s16(&out[i * 2], lr);
+    }
+
+    return i;
+#else
+    (void)out;
+    (void)samples;
+    (void)g;
+
+    return 0;
+#endif
+}
+
+static void Sound_MixBlock(int16_t *out, int samples, const mix_gains_t *g)
+{
+    int i = Sound_MixBlock_Vector(out, samples, g);
+
+    for ( ; i < samples; i++)
+    {
+        out[i * 2] = Sound_MixSample(dma_a_block[i], dma_b_block[i],
+                                     psg_left[i], g->dma_a_left,
+                                     g->dma_b_left, g);
+        out[i * 2 + 1] = Sound_MixSample(dma_a_block[i], dma_b_block[i],
+                                         psg_right[i], g->dma_a_right,
+                                         g->dma_b_right, g);
+    }
+}
+
 static void Sound_Mix_Buffers_VBL(void)
 {
     // DMA channels control
@@ -178,8 +451,6 @@ static void Sound_Mix_Buffers_VBL(void)
 
     // Note: The reset bits in SOUNDCNT_H are ignored.
 
-    // TODO: Read PSG master volume from SOUNDCNT_H
-
     int dma_a_right_enabled = REG_SOUNDCNT_H & SOUNDCNT_H_DMA_A_ENABLE_RIGHT;
     int dma_a_left_enabled = REG_SOUNDCNT_H & SOUNDCNT_H_DMA_A_ENABLE_LEFT;
 
@@ -201,39 +472,45 @@ static void Sound_Mix_Buffers_VBL(void)
     int dma_b_left_vol = (dma_b_left_enabled == 0) ? 0 :
                     (REG_SOUNDCNT_H & SOUNDCNT_H_DMA_B_VOLUME_100 ? 2 : 1);
 
-    // Mix channels
-    // ------------
-
-    // Always reset pointer to the start of the buffer, as all the data is
-    // always sent to SDL.
-    mixed.write_ptr = 0;
+    // The samples are multiplied by 128 so that the output reaches the full
+    // 16-bit range.
+    mix_gains_t gains = {
+        .dma_a_left = dma_a_left_vol << 7,
+        .dma_a_right = dma_a_right_vol << 7,
+        .dma_b_left = dma_b_left_vol << 7,
+        .dma_b_right = dma_b_right_vol << 7,
+        .master = (master_volume >= MASTER_VOLUME_MAX) ? 0 : master_volume,
+        .apply_master = (master_volume < MASTER_VOLUME_MAX),
+    };
 
-    // Loop until one of the buffers is empty
-    while (1)
-    {
-        if (Sound_BufferIsEmpty_DMA(0) || Sound_BufferIsEmpty_DMA(1))
-            break;
+    // Get blocks of samples
+    // ---------------------
 
-        // TODO: PSG channels
+    // Mix as many samples as both DMA channels have generated. The PSG output
+    // is already in the final range of the output.
 
-        int16_t sample_dma_a = Sound_GetSample_DMA(0);
-        int16_t sample_dma_b = Sound_GetSample_DMA(1);
+    int samples = Sound_BufferAvailable_DMA(0);
+    int samples_b = Sound_BufferAvailable_DMA(1);
+    if (samples_b < samples)
+        samples = samples_b;
 
-        int16_t sample_left = 0;
-        int16_t sample_right = 0;
+    Sound_ReadBlock_DMA(0, dma_a_block, samples);
+    Sound_ReadBlock_DMA(1, dma_b_block, samples);
 
-        // TODO: PSG channels
+    if (Sound_PSG_Generate(psg_left, psg_right, samples) == 0)
+    {
+        memset(psg_left, 0, samples * sizeof(int16_t));
+        memset(psg_right, 0, samples * sizeof(int16_t));
+    }
 
-        sample_left += sample_dma_a * dma_a_left_vol;
-        sample_left += sample_dma_b * dma_b_left_vol;
+    // Mix channels
+    // ------------
 
-        sample_right += sample_dma_a * dma_a_right_vol;
-        sample_right += sample_dma_b * dma_b_right_vol;
+    Sound_MixBlock(mixed.buffer, samples, &gains);
 
-        // Increase the volume a bit so that it reaches the full 16-bit range
-        mixed.buffer[mixed.write_ptr++] = sample_left << 7;
-        mixed.buffer[mixed.write_ptr++] = sample_right << 7;
-    }
+    // All the data is always sent to SDL, so the buffer is always filled from
+    // the start.
+    mixed.write_ptr = samples * 2;
 }
 
 // General sound helpers
@@ -254,25 +531,68 @@ static void Sound_MixBuffers_Empty(void)
     }
 }
 
-// Function that sends the mixed buffer to SDL
-static void Sound_SendToStream(void)
+// Capture sinks
+// =============
+
+#define SOUND_MAX_SINKS         (4)
+
+static sound_sink_fn sound_sinks[SOUND_MAX_SINKS];
+
+int Sound_SinkAdd(sound_sink_fn fn)
 {
-    int samples = mixed.write_ptr;
-    int size;
+    for (int i = 0; i < SOUND_MAX_SINKS; i++)
+    {
+        if (sound_sinks[i] == fn)
+            return 0;
+    }
+
+    for (int i = 0; i < SOUND_MAX_SINKS; i++)
+    {
+        if (sound_sinks[i] == NULL)
+        {
+            sound_sinks[i] = fn;
+            return 0;
+        }
+    }
+
+    Debug_Log("%s(): Too many sinks", __func__);
+    return 1;
+}
+
+void Sound_SinkRemove(sound_sink_fn fn)
+{
+    for (int i = 0; i < SOUND_MAX_SINKS; i++)
+    {
+        if (sound_sinks[i] == fn)
+            sound_sinks[i] = NULL;
+    }
+}
 
-    if (WAV_FileIsOpen())
+static int Sound_HasSinks(void)
+{
+    for (int i = 0; i < SOUND_MAX_SINKS; i++)
     {
-        size = samples * sizeof(int16_t);
-        WAV_FileStream(mixed.buffer, size);
+        if (sound_sinks[i] != NULL)
+            return 1;
     }
 
-    // If the sound buffer is too full, drop one left and one right sample
-    if (Sound_IsBufferOverThreshold())
-        samples -= 2;
+    return 0;
+}
+
+// Function that sends the mixed buffer to SDL and all the capture sinks
+static void Sound_SendToStream(void)
+{
+    int size = mixed.write_ptr * sizeof(int16_t);
 
-    size = samples * sizeof(int16_t);
+    for (int i = 0; i < SOUND_MAX_SINKS; i++)
+    {
+        sound_sink_fn fn = sound_sinks[i];
+        if (fn != NULL)
+            fn(mixed.buffer, size);
+    }
 
-    Sound_SendSamples(mixed.buffer, size);
+    if (Sound_OutputIsActive())
+        Sound_SendSamples(mixed.buffer, size);
 }
 
 // Public interfaces
@@ -280,20 +600,48 @@ static void Sound_SendToStream(void)
 
 void Sound_Handle_VBL(void)
 {
+    // If nobody is going to use the samples, only update the state of the
+    // channels so that they behave the same way as if they had been generated.
+    int has_consumers = Sound_OutputIsActive() || Sound_HasSinks();
+
     // Check if the sound master enable flag is disabled
     if (REG_SOUNDCNT_X & SOUNDCNT_X_MASTER_ENABLE)
     {
-        // TODO: PSG channels
+        if (has_consumers)
+        {
+            Sound_FillBuffers_VBL_DMA(0);
+            Sound_FillBuffers_VBL_DMA(1);
 
-        Sound_FillBuffers_VBL_DMA(0);
-        Sound_FillBuffers_VBL_DMA(1);
+            Sound_Mix_Buffers_VBL();
+        }
+        else
+        {
+            uint32_t samples = Sound_SkipBuffers_VBL_DMA(0);
+            Sound_SkipBuffers_VBL_DMA(1);
 
-        Sound_Mix_Buffers_VBL();
+            Sound_PSG_Skip(samples);
+        }
     }
     else
     {
-        Sound_MixBuffers_Empty();
+        // All PSG registers are reset when the master enable bit is cleared
+        Sound_PSG_Reset();
+
+        if (has_consumers)
+            Sound_MixBuffers_Empty();
     }
 
-    Sound_SendToStream();
+    if (has_consumers)
+        Sound_SendToStream();
+}
+
+void Sound_SetMasterVolume(int volume)
+{
+    if (volume < 0)
+        volume = 0;
+
+    if (volume >= 100)
+        master_volume = MASTER_VOLUME_MAX;
+    else
+        master_volume = (volume * MASTER_VOLUME_MAX) / 100;
 }
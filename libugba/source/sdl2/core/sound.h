@@ -5,6 +5,21 @@
 #ifndef SDL2_SOUND_H__
 #define SDL2_SOUND_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 void Sound_Handle_VBL(void);
 
+// Volume of the final output, from 0 to 100 (default)
+void Sound_SetMasterVolume(int volume);
+
+// A sink receives a copy of the stereo samples mixed every frame, at
+// GBA_SAMPLERATE. The size is in bytes. When there are no sinks and the audio
+// device isn't playing, the samples aren't generated at all.
+typedef void (*sound_sink_fn)(int16_t *buffer, size_t size);
+
+// Returns 0 on success
+int Sound_SinkAdd(sound_sink_fn fn);
+void Sound_SinkRemove(sound_sink_fn fn);
+
 #endif // SDL2_SOUND_H__
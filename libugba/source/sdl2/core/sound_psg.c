@@ -0,0 +1,622 @@
+// SPDX-License-Identifier: LGPL-3.0-only
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+#include <math.h>
+#include <string.h>
+
+#include <ugba/ugba.h>
+
+#include "sound_psg.h"
+
+#include "../sound_utils.h"
+
+// The PSG channels aren't emulated clock by clock. Every frame, the registers
+// are read and a block of samples is generated for each channel. Each output
+// sample is the average of the ideal waveform of the channel during the time
+// covered by that sample, so that high frequencies don't cause too much
+// aliasing.
+//
+// The timers of the frame sequencer are counted in output samples:
+//
+//     Length:   256 Hz -> 128 samples
+//     Sweep:    128 Hz -> 256 samples
+//     Envelope:  64 Hz -> 512 samples
+
+#define PSG_SAMPLES_PER_LENGTH_TICK     (GBA_SAMPLERATE / 256)
+
+// Each PSG channel can span a quarter of the output range of the DMA channels.
+#define PSG_CHANNEL_MAX_AMPLITUDE       (8192.0)
+
+typedef struct {
+    int enabled;
+
+    int volume; // 0 to 15
+    int env_increase;
+    int env_period; // In 64 Hz ticks, 0 = Disabled
+    int env_counter;
+
+    int length; // In 256 Hz ticks
+    int length_enable;
+} psg_common_t;
+
+typedef struct {
+    psg_common_t common;
+
+    double phase; // 0.0 to 1.0, position in the current period
+
+    int sweep_period; // In 128 Hz ticks, 0 = Disabled
+    int sweep_counter;
+} psg_square_t;
+
+typedef struct {
+    psg_common_t common;
+
+    double phase; // Position in the wave in samples
+} psg_wave_t;
+
+typedef struct {
+    psg_common_t common;
+
+    double phase; // 0.0 to 1.0, position in the current LFSR period
+    uint16_t lfsr;
+} psg_noise_t;
+
+static psg_square_t psg_square[2];
+static psg_wave_t psg_wave;
+static psg_noise_t psg_noise;
+
+static int length_tick_samples; // Samples elapsed since the last length tick
+static uint32_t frame_sequencer; // Number of length ticks so far
+
+static float channel_buffer[GBA_SAMPLERATE / 60 + 64];
+
+void Sound_PSG_Reset(void)
+{
+    memset(psg_square, 0, sizeof(psg_square));
+    memset(&psg_wave, 0, sizeof(psg_wave));
+    memset(&psg_noise, 0, sizeof(psg_noise));
+
+    length_tick_samples = 0;
+    frame_sequencer = 0;
+
+    REG_SOUNDCNT_X &= ~(SOUNDCNT_X_PSG_1_IS_ON | SOUNDCNT_X_PSG_2_IS_ON |
+                        SOUNDCNT_X_PSG_3_IS_ON | SOUNDCNT_X_PSG_4_IS_ON);
+}
+
+// Common helpers
+// ==============
+
+// Handle the restart of a channel with an envelope. Returns 1 if the channel is
+// enabled after the restart.
+static int Sound_PSG_RestartEnvelope(psg_common_t *ch, uint16_t env_reg,
+                                     int max_length)
+{
+    ch->volume = (env_reg >> 12) & 0xF;
+    ch->env_increase = (env_reg & (1 << 11)) ? 1 : 0;
+    ch->env_period = (env_reg >> 8) & 0x7;
+    ch->env_counter = ch->env_period;
+
+    ch->length = max_length - (env_reg & (max_length - 1));
+
+    // If the initial volume is 0 and it can only go down, the DAC is off
+    ch->enabled = (ch->volume != 0) || ch->env_increase;
+
+    return ch->enabled;
+}
+
+static void Sound_PSG_TickLength(psg_common_t *ch)
+{
+    if ((ch->enabled == 0) || (ch->length_enable == 0))
+        return;
+
+    if (ch->length > 0)
+        ch->length--;
+
+    if (ch->length == 0)
+        ch->enabled = 0;
+}
+
+static void Sound_PSG_TickEnvelope(psg_common_t *ch)
+{
+    if ((ch->enabled == 0) || (ch->env_period == 0))
+        return;
+
+    ch->env_counter--;
+    if (ch->env_counter > 0)
+        return;
+
+    ch->env_counter = ch->env_period;
+
+    if (ch->env_increase)
+    {
+        if (ch->volume < 15)
+            ch->volume++;
+    }
+    else
+    {
+        if (ch->volume > 0)
+            ch->volume--;
+    }
+}
+
+// Square channels
+// ===============
+
+// Integral of a square wave with amplitude +/-1 that is high during the first
+// part of each period (given by duty).
+static double Sound_PSG_SquareIntegral(double x, double duty)
+{
+    double periods = floor(x);
+    double frac = x - periods;
+
+    double integral = periods * (2.0 * duty - 1.0);
+
+    if (frac < duty)
+        integral += frac;
+    else
+        integral += 2.0 * duty - frac;
+
+    return integral;
+}
+
+static void Sound_PSG_SquareRestart(int index)
+{
+    psg_square_t *ch = &psg_square[index];
+
+    uint16_t duty_reg = (index == 0) ? REG_SOUND1CNT_H : REG_SOUND2CNT_L;
+
+    if (Sound_PSG_RestartEnvelope(&ch->common, duty_reg, 64) == 0)
+        return;
+
+    ch->phase = 0.0;
+
+    if (index == 0)
+    {
+        ch->sweep_period = (REG_SOUND1CNT_L >> 4) & 0x7;
+        ch->sweep_counter = ch->sweep_period;
+    }
+}
+
+static void Sound_PSG_SquareTickSweep(void)
+{
+    psg_square_t *ch = &psg_square[0];
+
+    if ((ch->common.enabled == 0) || (ch->sweep_period == 0))
+        return;
+
+    ch->sweep_counter--;
+    if (ch->sweep_counter > 0)
+        return;
+
+    ch->sweep_counter = ch->sweep_period;
+
+    uint16_t sweep_reg = REG_SOUND1CNT_L;
+    int shift = sweep_reg & 0x7;
+    if (shift == 0)
+        return;
+
+    uint16_t freq_reg = REG_SOUND1CNT_X;
+    int freq = freq_reg & 0x7FF;
+    int delta = freq >> shift;
+
+    if (sweep_reg & SOUND1CNT_L_SWEEP_DIR_DEC)
+        freq -= delta;
+    else
+        freq += delta;
+
+    if (freq > 0x7FF)
+    {
+        ch->common.enabled = 0;
+        return;
+    }
+
+    if (freq < 0)
+        freq = 0;
+
+    // The new frequency is written back to the register
+    REG_SOUND1CNT_X = (freq_reg & ~0x7FF) | freq;
+}
+
+static int Sound_PSG_SquareGenerate(int index, int samples)
+{
+    psg_square_t *ch = &psg_square[index];
+
+    if ((ch->common.enabled == 0) || (ch->common.volume == 0))
+        return 0;
+
+    uint16_t duty_reg = (index == 0) ? REG_SOUND1CNT_H : REG_SOUND2CNT_L;
+    uint16_t freq_reg = (index == 0) ? REG_SOUND1CNT_X : REG_SOUND2CNT_H;
+
+    const double duty_values[4] = { 0.125, 0.25, 0.5, 0.75 };
+    double duty = duty_values[(duty_reg >> 6) & 3];
+
+    // Frequency = 131072 / (2048 - n) Hz
+    double freq = 131072.0 / (double)(2048 - (freq_reg & 0x7FF));
+    double step = freq / (double)GBA_SAMPLERATE;
+
+    double gain = (double)ch->common.volume / 15.0;
+    double phase = ch->phase;
+    double integral = Sound_PSG_SquareIntegral(phase, duty);
+
+    for (int i = 0; i < samples; i++)
+    {
+        double next = Sound_PSG_SquareIntegral(phase + step, duty);
+        channel_buffer[i] = (float)(((next - integral) / step) * gain);
+
+        phase += step;
+        if (phase >= 1.0)
+        {
+            phase -= floor(phase);
+            next = Sound_PSG_SquareIntegral(phase, duty);
+        }
+        integral = next;
+    }
+
+    ch->phase = phase;
+
+    return 1;
+}
+
+// Wave channel
+// ============
+
+static void Sound_PSG_WaveRestart(void)
+{
+    psg_wave_t *ch = &psg_wave;
+
+    ch->common.volume = 15;
+    ch->common.env_period = 0;
+    ch->common.length = 256 - (REG_SOUND3CNT_H & 0xFF);
+    ch->common.enabled = (REG_SOUND3CNT_L & SOUND3CNT_L_ENABLE) ? 1 : 0;
+
+    ch->phase = 0.0;
+}
+
+static int Sound_PSG_WaveGenerate(int samples)
+{
+    psg_wave_t *ch = &psg_wave;
+
+    if ((REG_SOUND3CNT_L & SOUND3CNT_L_ENABLE) == 0)
+        ch->common.enabled = 0;
+
+    if (ch->common.enabled == 0)
+        return 0;
+
+    uint16_t volume_reg = REG_SOUND3CNT_H;
+
+    double gain;
+    if (volume_reg & (1 << 15)) // Force 75%
+    {
+        gain = 0.75;
+    }
+    else
+    {
+        int volume = (volume_reg >> 13) & 3;
+        if (volume == 0) // Mute
+            return 0;
+
+        const double gain_values[4] = { 0.0, 1.0, 0.5, 0.25 };
+        gain = gain_values[volume];
+    }
+
+    // The wave RAM has 32 4-bit samples. The emulated memory only has the bank
+    // that is visible from the CPU, so the 64-sample mode plays it twice.
+    const uint8_t *wave_ram = (const uint8_t *)REG_WAVE_RAM;
+
+    float wave[32];
+    for (int i = 0; i < 16; i++)
+    {
+        wave[i * 2] = (float)(((wave_ram[i] >> 4) - 7.5) / 7.5);
+        wave[i * 2 + 1] = (float)(((wave_ram[i] & 0xF) - 7.5) / 7.5);
+    }
+
+    int length = (REG_SOUND3CNT_L & SOUND3CNT_L_SIZE_64) ? 64 : 32;
+
+    // Sample rate = 2097152 / (2048 - n) Hz
+    double rate = 2097152.0 / (double)(2048 - (REG_SOUND3CNT_X & 0x7FF));
+    double step = rate / (double)GBA_SAMPLERATE;
+
+    double phase = ch->phase;
+
+    for (int i = 0; i < samples; i++)
+    {
+        // Average of all the wave samples played during this output sample
+        double remaining = step;
+        double acc = 0.0;
+
+        while (remaining > 0.0)
+        {
+            int index = (int)phase;
+            double available = (double)(index + 1) - phase;
+
+            double used = (available > remaining) ? remaining : available;
+            acc += wave[index & 31] * used;
+
+            phase += used;
+            remaining -= used;
+
+            if (phase >= (double)length)
+                phase -= (double)length;
+        }
+
+        channel_buffer[i] = (float)((acc / step) * gain);
+    }
+
+    ch->phase = phase;
+
+    return 1;
+}
+
+// Noise channel
+// =============
+
+static void Sound_PSG_NoiseRestart(void)
+{
+    psg_noise_t *ch = &psg_noise;
+
+    if (Sound_PSG_RestartEnvelope(&ch->common, REG_SOUND4CNT_L, 64) == 0)
+        return;
+
+    if (REG_SOUND4CNT_H & SOUND4CNT_H_WIDTH_7_BITS)
+        ch->lfsr = 0x7F;
+    else
+        ch->lfsr = 0x7FFF;
+
+    ch->phase = 0.0;
+}
+
+static int Sound_PSG_NoiseGenerate(int samples)
+{
+    psg_noise_t *ch = &psg_noise;
+
+    if ((ch->common.enabled == 0) || (ch->common.volume == 0))
+        return 0;
+
+    uint16_t noise_reg = REG_SOUND4CNT_H;
+
+    int shift = (noise_reg >> 4) & 0xF;
+    int ratio = noise_reg & 0x7;
+    int width_7 = noise_reg & SOUND4CNT_H_WIDTH_7_BITS;
+
+    // Frequency = 524288 / r / 2^(s + 1) Hz, with r = 0.5 when it is 0. The
+    // LFSR doesn't advance with shifts 14 and 15.
+    int stopped = (shift >= 14);
+
+    double r = (ratio == 0) ? 0.5 : (double)ratio;
+    double freq = 524288.0 / r / (double)(2 << shift);
+
+    double step = freq / (double)GBA_SAMPLERATE;
+    double gain = (double)ch->common.volume / 15.0;
+
+    double phase = ch->phase;
+    uint16_t lfsr = ch->lfsr;
+
+    for (int i = 0; i < samples; i++)
+    {
+        if (stopped)
+        {
+            channel_buffer[i] = (float)(((lfsr & 1) ? -1.0 : 1.0) * gain);
+            continue;
+        }
+
+        // Average of the output of the LFSR during this output sample
+        double remaining = step;
+        double acc = 0.0;
+
+        while (remaining > 0.0)
+        {
+            double out = (lfsr & 1) ? -1.0 : 1.0;
+            double available = 1.0 - phase;
+
+            if (available > remaining)
+            {
+                acc += out * remaining;
+                phase += remaining;
+                break;
+            }
+
+            acc += out * available;
+            remaining -= available;
+            phase = 0.0;
+
+            uint16_t bit = (lfsr ^ (lfsr >> 1)) & 1;
+            lfsr = (lfsr >> 1) | (bit << 14);
+            if (width_7)
+                lfsr = (lfsr & ~(1 << 6)) | (bit << 6);
+        }
+
+        channel_buffer[i] = (float)((acc / step) * gain);
+    }
+
+    ch->phase = phase;
+    ch->lfsr = lfsr;
+
+    return 1;
+}
+
+// Control
+// =======
+
+static void Sound_PSG_HandleRestarts(void)
+{
+    // The restart bits are write-only. Check them once per frame and clear
+    // them after restarting the channel.
+
+    if (REG_SOUND1CNT_X & SOUND1CNT_X_RESTART)
+    {
+        REG_SOUND1CNT_X &= ~SOUND1CNT_X_RESTART;
+        Sound_PSG_SquareRestart(0);
+    }
+
+    if (REG_SOUND2CNT_H & SOUND2CNT_H_RESTART)
+    {
+        REG_SOUND2CNT_H &= ~SOUND2CNT_H_RESTART;
+        Sound_PSG_SquareRestart(1);
+    }
+
+    if (REG_SOUND3CNT_X & SOUND3CNT_X_RESTART)
+    {
+        REG_SOUND3CNT_X &= ~SOUND3CNT_X_RESTART;
+        Sound_PSG_WaveRestart();
+    }
+
+    if (REG_SOUND4CNT_H & SOUND4CNT_H_RESTART)
+    {
+        REG_SOUND4CNT_H &= ~SOUND4CNT_H_RESTART;
+        Sound_PSG_NoiseRestart();
+    }
+
+    psg_square[0].common.length_enable =
+            (REG_SOUND1CNT_X & SOUND1CNT_X_ONE_SHOT) ? 1 : 0;
+    psg_square[1].common.length_enable =
+            (REG_SOUND2CNT_H & SOUND2CNT_H_ONE_SHOT) ? 1 : 0;
+    psg_wave.common.length_enable =
+            (REG_SOUND3CNT_X & SOUND3CNT_X_ONE_SHOT) ? 1 : 0;
+    psg_noise.common.length_enable =
+            (REG_SOUND4CNT_H & SOUND4CNT_H_ONE_SHOT) ? 1 : 0;
+}
+
+static void Sound_PSG_AdvanceSequencer(int samples)
+{
+    length_tick_samples += samples;
+
+    while (length_tick_samples >= PSG_SAMPLES_PER_LENGTH_TICK)
+    {
+        length_tick_samples -= PSG_SAMPLES_PER_LENGTH_TICK;
+        frame_sequencer++;
+
+        Sound_PSG_TickLength(&psg_square[0].common);
+        Sound_PSG_TickLength(&psg_square[1].common);
+        Sound_PSG_TickLength(&psg_wave.common);
+        Sound_PSG_TickLength(&psg_noise.common);
+
+        if ((frame_sequencer & 1) == 0)
+            Sound_PSG_SquareTickSweep();
+
+        if ((frame_sequencer & 3) == 0)
+        {
+            Sound_PSG_TickEnvelope(&psg_square[0].common);
+            Sound_PSG_TickEnvelope(&psg_square[1].common);
+            Sound_PSG_TickEnvelope(&psg_noise.common);
+        }
+    }
+}
+
+static void Sound_PSG_UpdateStatus(void)
+{
+    uint16_t status = 0;
+
+    if (psg_square[0].common.enabled)
+        status |= SOUNDCNT_X_PSG_1_IS_ON;
+    if (psg_square[1].common.enabled)
+        status |= SOUNDCNT_X_PSG_2_IS_ON;
+    if (psg_wave.common.enabled)
+        status |= SOUNDCNT_X_PSG_3_IS_ON;
+    if (psg_noise.common.enabled)
+        status |= SOUNDCNT_X_PSG_4_IS_ON;
+
+    uint16_t mask = SOUNDCNT_X_PSG_1_IS_ON | SOUNDCNT_X_PSG_2_IS_ON |
+                    SOUNDCNT_X_PSG_3_IS_ON | SOUNDCNT_X_PSG_4_IS_ON;
+
+    REG_SOUNDCNT_X = (REG_SOUNDCNT_X & ~mask) | status;
+}
+
+int Sound_PSG_Generate(int16_t *left, int16_t *right, int samples)
+{
+    const int max_samples = sizeof(channel_buffer) / sizeof(channel_buffer[0]);
+    if (samples > max_samples)
+        samples = max_samples;
+
+    Sound_PSG_HandleRestarts();
+
+    uint16_t control = REG_SOUNDCNT_L;
+
+    // GBATEK: The "prohibited" ratio value 3 acts as 100%
+    const double ratio_values[4] = { 0.25, 0.5, 1.0, 1.0 };
+    double ratio = ratio_values[REG_SOUNDCNT_H & 3];
+
+    double volume_right = PSG_CHANNEL_MAX_AMPLITUDE * ratio
+                        * (double)(control & 0x7) / 7.0;
+    double volume_left = PSG_CHANNEL_MAX_AMPLITUDE * ratio
+                       * (double)((control >> 4) & 0x7) / 7.0;
+
+    int active = 0;
+
+    static float mix_left[sizeof(channel_buffer) / sizeof(channel_buffer[0])];
+    static float mix_right[sizeof(channel_buffer) / sizeof(channel_buffer[0])];
+
+    for (int channel = 0; channel < 4; channel++)
+    {
+        int enable_right = control & (SOUNDCNT_L_PSG_1_ENABLE_RIGHT << channel);
+        int enable_left = control & (SOUNDCNT_L_PSG_1_ENABLE_LEFT << channel);
+
+        // The channels are generated even if they aren't sent to any side so
+        // that they stay in sync.
+
+        int generated;
+
+        if (channel < 2)
+            generated = Sound_PSG_SquareGenerate(channel, samples);
+        else if (channel == 2)
+            generated = Sound_PSG_WaveGenerate(samples);
+        else
+            generated = Sound_PSG_NoiseGenerate(samples);
+
+        if (generated == 0)
+            continue;
+
+        if ((enable_left == 0) && (enable_right == 0))
+            continue;
+
+        if (active == 0)
+        {
+            memset(mix_left, 0, samples * sizeof(float));
+            memset(mix_right, 0, samples * sizeof(float));
+            active = 1;
+        }
+
+        float gain_left = enable_left ? (float)volume_left : 0.0f;
+        float gain_right = enable_right ? (float)volume_right : 0.0f;
+
+        for (int i = 0; i < samples; i++)
+        {
+            mix_left[i] += channel_buffer[i] * gain_left;
+            mix_right[i] += channel_buffer[i] * gain_right;
+        }
+    }
+
+    Sound_PSG_AdvanceSequencer(samples);
+    Sound_PSG_UpdateStatus();
+
+    if (active == 0)
+        return 0;
+
+    for (int i = 0; i < samples; i++)
+    {
+        float l = mix_left[i];
+        float r = mix_right[i];
+
+        if (l > INT16_MAX)
+            l = INT16_MAX;
+        else if (l < INT16_MIN)
+            l = INT16_MIN;
+
+        if (r > INT16_MAX)
+            r = INT16_MAX;
+        else if (r < INT16_MIN)
+            r = INT16_MIN;
+
+        left[i] = (int16_t)lrintf(l);
+        right[i] = (int16_t)lrintf(r);
+    }
+
+    return 1;
+}
+
+void Sound_PSG_Skip(int samples)
+{
+    Sound_PSG_HandleRestarts();
+    Sound_PSG_AdvanceSequencer(samples);
+    Sound_PSG_UpdateStatus();
+}
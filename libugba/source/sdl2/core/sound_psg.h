@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: LGPL-3.0-only
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+#ifndef SDL2_CORE_SOUND_PSG_H__
+#define SDL2_CORE_SOUND_PSG_H__
+
+#include <stdint.h>
+
+// Stop all PSG channels and reset their state
+void Sound_PSG_Reset(void);
+
+// Generate the mixed output of the four PSG channels at GBA_SAMPLERATE. The
+// output is already scaled by the PSG volume controls of SOUNDCNT_L and
+// SOUNDCNT_H, in the same range as the final output of the mixer. Returns 0 if
+// all channels are silent (and the buffers haven't been written), 1 otherwise.
+//
+// The registers of the PSG channels are read once per call, and the envelope,
+// sweep and length counters are updated at the end of the block.
+int Sound_PSG_Generate(int16_t *left, int16_t *right, int samples);
+
+// Update the state of the channels as if a block of samples had been generated
+void Sound_PSG_Skip(int samples);
+
+#endif // SDL2_CORE_SOUND_PSG_H__
@@ -12,6 +12,14 @@
 
 static uint16_t curr_value[4];
 
+// In deterministic mode the timers are driven by the emulated scanlines instead
+// of SDL timers, which run in a different thread and depend on the wall clock.
+static int timers_deterministic = 0;
+static uint32_t period_clocks[4];
+static uint32_t elapsed_clocks[4];
+
+#define GBA_CLOCKS_PER_SCANLINE (280896 / 228)
+
 static Uint32 Timer_3_Callback(Uint32 interval, UNUSED void *param)
 {
     if (REG_IME == 1)
@@ -105,7 +113,13 @@ static void GBA_RefreshTimer(int index)
     uint16_t flags = *tmcnt_h[index];
 
     if (TimerID[index])
+    {
         SDL_RemoveTimer(TimerID[index]);
+        TimerID[index] = 0;
+    }
+
+    period_clocks[index] = 0;
+    elapsed_clocks[index] = 0;
 
     if ((flags & TMCNT_START) == 0)
         return;
@@ -140,9 +154,50 @@ static void GBA_RefreshTimer(int index)
         return;
     }
 
+    if (timers_deterministic)
+    {
+        // Timers in cascade mode are only updated when the previous one
+        // overflows.
+        if ((index > 0) && (flags & TMCNT_CASCADE))
+            return;
+
+        period_clocks[index] = (uint32_t)clocks_per_period;
+        return;
+    }
+
     TimerID[index] = SDL_AddTimer(delay_ms, timer_callback[index], NULL);
 }
 
+void GBA_TimerSetDeterministic(int enable)
+{
+    timers_deterministic = enable;
+
+    for (int i = 0; i < 4; i++)
+        GBA_RefreshTimer(i);
+}
+
+void GBA_TimerHandleScanline(void)
+{
+    if (timers_deterministic == 0)
+        return;
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (period_clocks[i] == 0)
+            continue;
+
+        elapsed_clocks[i] += GBA_CLOCKS_PER_SCANLINE;
+
+        // The interrupt handler may stop or reconfigure the timer
+        while ((period_clocks[i] != 0) &&
+               (elapsed_clocks[i] >= period_clocks[i]))
+        {
+            elapsed_clocks[i] -= period_clocks[i];
+            timer_callback[i](0, NULL);
+        }
+    }
+}
+
 void GBA_TimerUpdateRegister(uint32_t offset)
 {
     if (offset == OFFSET_TM0CNT_H)
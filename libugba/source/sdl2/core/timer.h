@@ -7,4 +7,10 @@
 
 void GBA_TimerUpdateRegister(uint32_t offset);
 
+// When enabled, timers are updated by GBA_TimerHandleScanline() instead of
+// using SDL timers. This makes the number of timer interrupts per frame always
+// the same, regardless of the speed of the emulation.
+void GBA_TimerSetDeterministic(int enable);
+void GBA_TimerHandleScanline(void);
+
 #endif // SDL2_CORE_TIMER_H__
@@ -2940,6 +2940,11 @@ void GBA_VideoUpdateRegister(uint32_t offset)
 
 //------------------------------------------------------------------------------
 
+const uint16_t *GBA_GetScreenBuffer(void)
+{
+    return screen_buffer_array[curr_screen_buffer ^ 1];
+}
+
 void GBA_ConvertScreenBufferTo32RGB(void *dst)
 {
     uint16_t *src = screen_buffer_array[curr_screen_buffer ^ 1];
@@ -5,6 +5,8 @@
 #ifndef SDL2_CORE_VIDEO__
 #define SDL2_CORE_VIDEO__
 
+#include <stdint.h>
+
 void GBA_SkipFrame(int skip);
 int GBA_HasToSkipFrame(void);
 
@@ -20,6 +22,9 @@ void GBA_VideoUpdateRegister(unsigned int address);
 void GBA_DrawScanline(int y);
 void GBA_DrawScanlineWhite(int y);
 
+// Returns the RGB555 frame that is shown on the screen (240x160 pixels)
+const uint16_t *GBA_GetScreenBuffer(void);
+
 // 24-bit RGB
 void GBA_ConvertScreenBufferTo24RGB(void *dst);
 // 32-bit RGB (with alpha set to 255 in all pixels)
@@ -11,6 +11,7 @@
 
 #include "debug_utils.h"
 #include "input_utils.h"
+#include "movie_utils.h"
 
 //------------------------------------------------------------------------------
 
@@ -224,8 +225,20 @@ static void GBA_HandleInput(int a, int b, int l, int r, int st, int se,
     REG_KEYINPUT = input;
 }
 
+static int late_polling = 0;
+
+static Uint64 input_sample_counter = 0;
+static input_latency_stats latency;
+static double latency_total_ms = 0.0;
+
 void Input_Update_GBA(void)
 {
+    // When a movie is being replayed the input comes from the movie
+    if (Movie_IsPlaying())
+        return;
+
+    input_sample_counter = SDL_GetPerformanceCounter();
+
     int a = Input_IsGameBoyKeyPressed(P_KEY_A);
     int b = Input_IsGameBoyKeyPressed(P_KEY_B);
     int l = Input_IsGameBoyKeyPressed(P_KEY_L);
@@ -242,11 +255,60 @@ void Input_Update_GBA(void)
 
 int Input_Speedup_Enabled(void)
 {
+    // Movies are always replayed as fast as possible
+    if (Movie_IsPlaying())
+        return 1;
+
     const Uint8 *state = SDL_GetKeyboardState(NULL);
 
     return state[SDL_SCANCODE_SPACE];
 }
 
+void Input_SetLatePolling(int enable)
+{
+    late_polling = enable;
+
+    Input_ResetLatencyStats();
+}
+
+int Input_LatePollingEnabled(void)
+{
+    return late_polling;
+}
+
+void Input_GameResumed(void)
+{
+    // Only measure frames where the input has been sampled from the devices
+    if (input_sample_counter == 0)
+        return;
+
+    Uint64 elapsed = SDL_GetPerformanceCounter() - input_sample_counter;
+    input_sample_counter = 0;
+
+    double elapsed_ms = (double)elapsed * 1000.0
+                      / (double)SDL_GetPerformanceFrequency();
+
+    latency.frames++;
+    latency.last_ms = elapsed_ms;
+    if (elapsed_ms > latency.max_ms)
+        latency.max_ms = elapsed_ms;
+
+    latency_total_ms += elapsed_ms;
+    latency.average_ms = latency_total_ms / (double)latency.frames;
+}
+
+void Input_GetLatencyStats(input_latency_stats *stats)
+{
+    *stats = latency;
+}
+
+void Input_ResetLatencyStats(void)
+{
+    memset(&latency, 0, sizeof(latency));
+    latency_total_ms = 0.0;
+    input_sample_counter = 0;
+}
+
 //------------------------------------------------------------------------------
 
 SDL_Joystick *Input_GetJoystick(int index)
@@ -46,6 +46,27 @@ void Input_Update_GBA(void);
 
 int Input_Speedup_Enabled(void);
 
+// With late polling, the input is sampled after waiting for the start of the
+// next frame, right before the game resumes, instead of before waiting. This
+// reduces the delay between the input and the frame that reacts to it.
+void Input_SetLatePolling(int enable);
+int Input_LatePollingEnabled(void);
+
+// Called right before the game resumes after the VBL handling is done. It's
+// used to measure the time between sampling the input and using it.
+void Input_GameResumed(void);
+
+typedef struct {
+    uint32_t frames;
+    double last_ms;
+    double average_ms;
+    double max_ms;
+} input_latency_stats;
+
+// Statistics of the time between sampling the input and resuming the game
+void Input_GetLatencyStats(input_latency_stats *stats);
+void Input_ResetLatencyStats(void);
+
 //-----------------------------------------------------------------------------
 
 // btncode is a SDL_KeyCode
@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: LGPL-3.0-only
 //
-// Copyright (c) 2020 Antonio Niño Díaz
+// Copyright (c) 2020-2021 Antonio Niño Díaz
 
 #include <SDL2/SDL.h>
 
@@ -12,10 +12,15 @@
 
 #include <ugba/ugba.h>
 
+#include "capture_utils.h"
 #include "debug_utils.h"
+#include "input_utils.h"
+#include "movie_utils.h"
 #include "sound_utils.h"
 #include "wav_utils.h"
 
+#include "core/dma.h"
+
 #include "gui/win_main.h"
 
 static char *script_path = NULL;
@@ -237,6 +242,26 @@ static int lua_wav_record_start(lua_State *L)
 
         lua_pop(L, 1);
     }
+    else if (narg == 2)
+    {
+        const char *name = lua_tostring(L, -2);
+        lua_Integer sample_rate = lua_tointeger(L, -1);
+
+        Debug_Log("%s(%s, %lld)", __func__, name, sample_rate);
+
+        // lua_tointeger() returns 0 if the argument isn't a number
+        if ((sample_rate < WAV_SAMPLE_RATE_MIN) ||
+            (sample_rate > WAV_SAMPLE_RATE_MAX))
+        {
+            Debug_Log("%s(): Invalid sample rate", __func__);
+        }
+        else
+        {
+            WAV_FileStart(name, sample_rate);
+        }
+
+        lua_pop(L, 2);
+    }
     else
     {
         Debug_Log("%s(): Invalid number of arguments: %d", __func__, narg);
@@ -265,6 +290,265 @@ static int lua_wav_record_end(lua_State *L)
     return 0;
 }
 
+static int lua_movie_record_start(lua_State *L)
+{
+    // Number of arguments
+    int narg = lua_gettop(L);
+    if (narg == 0)
+    {
+        Debug_Log("%s()", __func__);
+        Movie_RecordStart(NULL);
+    }
+    else if (narg == 1)
+    {
+        const char *name = lua_tostring(L, -1);
+
+        Debug_Log("%s(%s)", __func__, name);
+        Movie_RecordStart(name);
+
+        lua_pop(L, 1);
+    }
+    else
+    {
+        Debug_Log("%s(): Invalid number of arguments: %d", __func__, narg);
+        return 0;
+    }
+
+    // Number of results
+    return 0;
+}
+
+static int lua_movie_play_start(lua_State *L)
+{
+    // Number of arguments
+    int narg = lua_gettop(L);
+    if (narg == 0)
+    {
+        Debug_Log("%s()", __func__);
+        Movie_PlayStart(NULL, 0);
+    }
+    else if (narg == 1)
+    {
+        const char *name = lua_tostring(L, -1);
+
+        Debug_Log("%s(%s)", __func__, name);
+        Movie_PlayStart(name, 0);
+
+        lua_pop(L, 1);
+    }
+    else
+    {
+        Debug_Log("%s(): Invalid number of arguments: %d", __func__, narg);
+        return 0;
+    }
+
+    // Number of results
+    return 0;
+}
+
+static int lua_movie_end(lua_State *L)
+{
+    // Number of arguments
+    int narg = lua_gettop(L);
+    if (narg != 0)
+    {
+        Debug_Log("%s(): Invalid number of arguments: %d", __func__, narg);
+        return 0;
+    }
+
+    Debug_Log("%s()", __func__);
+
+    Movie_End();
+
+    // Number of results
+    return 0;
+}
+
+static int lua_capture_start(lua_State *L)
+{
+    // Number of arguments
+    int narg = lua_gettop(L);
+    if (narg == 0)
+    {
+        Debug_Log("%s()", __func__);
+        Capture_Start(NULL);
+    }
+    else if (narg == 1)
+    {
+        const char *name = lua_tostring(L, -1);
+
+        Debug_Log("%s(%s)", __func__, name);
+        Capture_Start(name);
+
+        lua_pop(L, 1);
+    }
+    else
+    {
+        Debug_Log("%s(): Invalid number of arguments: %d", __func__, narg);
+        return 0;
+    }
+
+    // Number of results
+    return 0;
+}
+
+static int lua_capture_end(lua_State *L)
+{
+    // Number of arguments
+    int narg = lua_gettop(L);
+    if (narg != 0)
+    {
+        Debug_Log("%s(): Invalid number of arguments: %d", __func__, narg);
+        return 0;
+    }
+
+    Debug_Log("%s()", __func__);
+
+    Capture_End();
+
+    // Number of results
+    return 0;
+}
+
+static int lua_input_late_polling(lua_State *L)
+{
+    // Number of arguments
+    int narg = lua_gettop(L);
+    if (narg != 1)
+    {
+        Debug_Log("%s(): Invalid number of arguments: %d", __func__, narg);
+        return 0;
+    }
+
+    // Get argument of the function and remove it from the stack
+    lua_Integer enable = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+
+    Debug_Log("%s(%lld)", __func__, enable);
+
+    Input_SetLatePolling(enable ? 1 : 0);
+
+    // Number of results
+    return 0;
+}
+
+static int lua_input_latency(lua_State *L)
+{
+    // Number of arguments
+    int narg = lua_gettop(L);
+    if (narg != 0)
+    {
+        Debug_Log("%s(): Invalid number of arguments: %d", __func__, narg);
+        return 0;
+    }
+
+    input_latency_stats stats;
+    Input_GetLatencyStats(&stats);
+
+    Debug_Log("%s(): Frames: %u | Average: %.3f ms | Max: %.3f ms", __func__,
+              stats.frames, stats.average_ms, stats.max_ms);
+
+    lua_pushnumber(L, stats.average_ms);
+    lua_pushnumber(L, stats.max_ms);
+    lua_pushinteger(L, stats.frames);
+
+    // Number of results
+    return 3;
+}
+
+static int lua_sound_latency(lua_State *L)
+{
+    // Number of arguments
+    int narg = lua_gettop(L);
+    if (narg != 0)
+    {
+        Debug_Log("%s(): Invalid number of arguments: %d", __func__, narg);
+        return 0;
+    }
+
+    sound_latency_stats stats;
+    Sound_GetLatencyStats(&stats);
+
+    Debug_Log("%s(): Average: %.3f ms | Max: %.3f ms | Underruns: %u | "
+              "Buffer: %d samples", __func__, stats.average_ms, stats.max_ms,
+              stats.underruns, stats.buffer_samples);
+
+    lua_pushnumber(L, stats.average_ms);
+    lua_pushnumber(L, stats.max_ms);
+    lua_pushinteger(L, stats.underruns);
+    lua_pushinteger(L, stats.buffer_samples);
+
+    // Number of results
+    return 4;
+}
+
+static int lua_dma_stats(lua_State *L)
+{
+    // Number of arguments
+    int narg = lua_gettop(L);
+    if (narg != 1)
+    {
+        Debug_Log("%s(): Invalid number of arguments: %d", __func__, narg);
+        return 0;
+    }
+
+    // Get argument of the function and remove it from the stack
+    lua_Integer channel = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+
+    const dma_channel_stats *stats = GBA_DMAGetStats(channel);
+    if (stats == NULL)
+    {
+        Debug_Log("%s(): Invalid channel: %lld", __func__, channel);
+        return 0;
+    }
+
+    static const char *kind_name[DMA_COPY_KIND_NUMBER] = {
+        [DMA_COPY_MEMMOVE] = "Copy",
+        [DMA_COPY_FILL] = "Fill",
+        [DMA_COPY_LAST] = "Last",
+        [DMA_COPY_GENERIC] = "Generic",
+    };
+
+    uint64_t transfers = 0;
+    uint64_t bytes = 0;
+
+    for (int i = 0; i < DMA_COPY_KIND_NUMBER; i++)
+    {
+        Debug_Log("%s(%lld): %s: %llu transfers | %llu bytes", __func__,
+                  channel, kind_name[i],
+                  (unsigned long long)stats->transfers[i],
+                  (unsigned long long)stats->bytes[i]);
+
+        transfers += stats->transfers[i];
+        bytes += stats->bytes[i];
+    }
+
+    lua_pushinteger(L, transfers);
+    lua_pushinteger(L, bytes);
+
+    // Number of results
+    return 2;
+}
+
+static int lua_dma_stats_reset(lua_State *L)
+{
+    // Number of arguments
+    int narg = lua_gettop(L);
+    if (narg != 0)
+    {
+        Debug_Log("%s(): Invalid number of arguments: %d", __func__, narg);
+        return 0;
+    }
+
+    Debug_Log("%s()", __func__);
+
+    GBA_DMAResetStats();
+
+    // Number of results
+    return 0;
+}
+
 static int lua_exit(lua_State *L)
 {
     // Number of arguments
@@ -314,6 +598,16 @@ static int Script_Runner(UNUSED void *ptr)
     lua_register(L, "keys_release", lua_keys_release);
     lua_register(L, "wav_record_start", lua_wav_record_start);
     lua_register(L, "wav_record_end", lua_wav_record_end);
+    lua_register(L, "movie_record_start", lua_movie_record_start);
+    lua_register(L, "movie_play_start", lua_movie_play_start);
+    lua_register(L, "movie_end", lua_movie_end);
+    lua_register(L, "capture_start", lua_capture_start);
+    lua_register(L, "capture_end", lua_capture_end);
+    lua_register(L, "input_late_polling", lua_input_late_polling);
+    lua_register(L, "input_latency", lua_input_latency);
+    lua_register(L, "sound_latency", lua_sound_latency);
+    lua_register(L, "dma_stats", lua_dma_stats);
+    lua_register(L, "dma_stats_reset", lua_dma_stats_reset);
     lua_register(L, "exit", lua_exit);
 
     // Run script with 0 arguments and expect one return value
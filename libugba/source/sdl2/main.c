@@ -8,11 +8,14 @@
 
 #include <ugba/ugba.h>
 
+#include "capture_utils.h"
 #include "debug_utils.h"
 #include "input_utils.h"
 #include "lua_handler.h"
+#include "movie_utils.h"
 #include "sound_utils.h"
 
+#include "core/sound.h"
 #include "core/video.h"
 #include "gui/win_main.h"
 #include "gui/window_handler.h"
@@ -57,26 +60,85 @@ static int InitHeadless(void)
 
 static void UGBA_ParseArgs(int *argc, char **argv[])
 {
-    if ((argc != NULL) && (argv != NULL))
+    if ((argc == NULL) || (argv == NULL))
+        return;
+
+    while (*argc > 1)
     {
-        if (*argc > 2)
+        const char *option = (*argv)[1];
+        const char *value = (*argc > 2) ? (*argv)[2] : NULL;
+
+        // Number of elements of argv used by this option
+        int used = 2;
+
+        if (strcmp(option, "--late-input") == 0)
+        {
+            Input_SetLatePolling(1);
+            used = 1;
+        }
+        else if (value == NULL)
+        {
+            // The rest of the options need one argument
+            break;
+        }
+        else if (strcmp(option, "--lua") == 0)
         {
-            if (strcmp((*argv)[1], "--lua") == 0)
-            {
 #ifdef LUA_INTERPRETER_ENABLED
-                Script_RunLua((*argv)[2]);
+            Script_RunLua(value);
 #else
-                Debug_Log("UGBA compiled without Lua support.\n");
+            Debug_Log("UGBA compiled without Lua support.\n");
 #endif
+        }
+        else if (strcmp(option, "--audio-buffer") == 0)
+        {
+            // Size of the buffer of the audio device in samples, or "auto"
+            Sound_SetBufferSamples(atoi(value));
+        }
+        else if (strcmp(option, "--audio-latency") == 0)
+        {
+            // Amount of audio queued in milliseconds, or "auto"
+            Sound_SetLatencyTarget(atoi(value));
+        }
+        else if (strcmp(option, "--audio-quality") == 0)
+        {
+            // Quality of the resampler: "linear", "fir8" or "fir32"
+            if (strcmp(value, "linear") == 0)
+                Sound_SetResamplerQuality(RESAMPLER_LINEAR);
+            else if (strcmp(value, "fir8") == 0)
+                Sound_SetResamplerQuality(RESAMPLER_FIR_8);
+            else if (strcmp(value, "fir32") == 0)
+                Sound_SetResamplerQuality(RESAMPLER_FIR_32);
+            else
+                Debug_Log("Invalid audio quality: %s", value);
+        }
+        else if (strcmp(option, "--audio-volume") == 0)
+        {
+            // Volume of the output, from 0 to 100
+            Sound_SetMasterVolume(atoi(value));
+        }
+        else if (strcmp(option, "--capture") == 0)
+        {
+            Capture_Start(value);
+        }
+        else if (strcmp(option, "--movie-record") == 0)
+        {
+            Movie_RecordStart(value);
+        }
+        else if (strcmp(option, "--movie-play") == 0)
+        {
+            Movie_PlayStart(value, 1);
+        }
+        else
+        {
+            break;
+        }
 
-                // Remove argv[1] and argv[2]
+        // Remove the option and its argument from argv
 
-                for (int i = 1; i < *argc - 2; i++)
-                    (*argv)[i] = (*argv)[i + 2];
+        for (int i = 1; i < *argc - used; i++)
+            (*argv)[i] = (*argv)[i + used];
 
-                *argc = *argc - 2;
-            }
-        }
+        *argc = *argc - used;
     }
 }
 
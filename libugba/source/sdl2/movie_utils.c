@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: LGPL-3.0-only
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <SDL2/SDL.h>
+
+#include <ugba/ugba.h>
+
+#include "debug_utils.h"
+#include "movie_utils.h"
+
+#include "core/timer.h"
+#include "core/video.h"
+#include "gui/win_main.h"
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t magic;         // "UGBM" == 0x4D424755
+    uint16_t version;       // MOVIE_VERSION
+    uint16_t header_size;   // Size of this header
+    uint32_t num_frames;    // Number of frames stored after the header
+    uint32_t frame_hash;    // Hash of all the frames drawn while recording
+    // uint16_t keyinput[]  // State of REG_KEYINPUT of each frame
+} movie_header_t;
+#pragma pack(pop)
+
+#define MOVIE_MAGIC         (0x4D424755)
+#define MOVIE_VERSION       (1)
+
+#define KEYINPUT_MASK       (0x03FF)
+
+typedef enum {
+    MOVIE_NONE,
+    MOVIE_RECORDING,
+    MOVIE_PLAYING
+} movie_state_t;
+
+static movie_state_t movie_state = MOVIE_NONE;
+
+static FILE *movie_file; // Only used when recording
+static uint16_t *movie_frames; // Only used when replaying
+static uint32_t movie_num_frames;
+static uint32_t movie_current_frame;
+static uint32_t movie_expected_hash;
+static int movie_exit_at_end;
+
+static uint32_t movie_frame_hash;
+static uint32_t movie_start_ticks;
+
+// FNV-1a hash of the frame shown on the screen, chained with the hash of the
+// previous frames.
+
+#define FNV_OFFSET_BASIS    (2166136261U)
+#define FNV_PRIME           (16777619U)
+
+static uint32_t Movie_HashFrame(uint32_t hash)
+{
+    const uint16_t *src = GBA_GetScreenBuffer();
+
+    for (int i = 0; i < 240 * 160; i++)
+    {
+        uint16_t pixel = src[i];
+
+        hash ^= pixel & 0xFF;
+        hash *= FNV_PRIME;
+        hash ^= pixel >> 8;
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static void Movie_Begin(movie_state_t state)
+{
+    movie_state = state;
+    movie_current_frame = 0;
+    movie_frame_hash = FNV_OFFSET_BASIS;
+    movie_start_ticks = SDL_GetTicks();
+
+    GBA_TimerSetDeterministic(1);
+}
+
+void Movie_End(void)
+{
+    if (movie_state == MOVIE_NONE)
+        return;
+
+    uint32_t elapsed_ms = SDL_GetTicks() - movie_start_ticks;
+    uint32_t frames = movie_current_frame;
+
+    if (movie_state == MOVIE_RECORDING)
+    {
+        // Now that the number of frames is known, write the header
+
+        movie_header_t header = {
+            .magic = MOVIE_MAGIC,
+            .version = MOVIE_VERSION,
+            .header_size = sizeof(movie_header_t),
+            .num_frames = frames,
+            .frame_hash = movie_frame_hash,
+        };
+
+        fseek(movie_file, 0, SEEK_SET);
+
+        if (fwrite(&header, sizeof(header), 1, movie_file) != 1)
+            Debug_Log("%s(): Can't write header.", __func__);
+
+        fclose(movie_file);
+        movie_file = NULL;
+    }
+    else // if (movie_state == MOVIE_PLAYING)
+    {
+        free(movie_frames);
+        movie_frames = NULL;
+    }
+
+    double fps = 0.0;
+    if (elapsed_ms > 0)
+        fps = (double)frames * 1000.0 / (double)elapsed_ms;
+
+    const char *result = "";
+    if (movie_state == MOVIE_PLAYING)
+    {
+        if (frames != movie_num_frames)
+            result = " (incomplete)";
+        else if (movie_frame_hash == movie_expected_hash)
+            result = " (match)";
+        else
+            result = " (mismatch)";
+    }
+
+    printf("movie: frames %u, time %u ms, fps %.2f, hash %08X%s\n",
+           frames, elapsed_ms, fps, movie_frame_hash, result);
+    Debug_Log("%s: Frames %u, time %u ms, FPS %.2f, hash %08X%s", __func__,
+              frames, elapsed_ms, fps, movie_frame_hash, result);
+
+    int exit_program = (movie_state == MOVIE_PLAYING) && movie_exit_at_end;
+
+    movie_state = MOVIE_NONE;
+
+    GBA_TimerSetDeterministic(0);
+
+    if (exit_program)
+        Win_MainExit();
+}
+
+int Movie_RecordStart(const char *path)
+{
+    static int atexit_registered = 0;
+
+    if (path == NULL)
+        path = "movie.ugbm";
+
+    Movie_End();
+
+    movie_file = fopen(path, "wb");
+    if (movie_file == NULL)
+    {
+        Debug_Log("%s(): Can't open file for writing: %s", __func__, path);
+        return 1;
+    }
+
+    // Leave space for the header, it is written at the end
+    movie_header_t header = { 0 };
+    if (fwrite(&header, sizeof(header), 1, movie_file) != 1)
+    {
+        Debug_Log("%s(): Can't allocate space for header.", __func__);
+        fclose(movie_file);
+        movie_file = NULL;
+        return 1;
+    }
+
+    // Save the file when the program exits
+    if (atexit_registered == 0)
+    {
+        atexit(Movie_End);
+        atexit_registered = 1;
+    }
+
+    Movie_Begin(MOVIE_RECORDING);
+
+    return 0;
+}
+
+int Movie_PlayStart(const char *path, int exit_at_end)
+{
+    if (path == NULL)
+        path = "movie.ugbm";
+
+    Movie_End();
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        Debug_Log("%s(): Can't open file: %s", __func__, path);
+        return 1;
+    }
+
+    movie_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1)
+    {
+        Debug_Log("%s(): Can't read header: %s", __func__, path);
+        fclose(f);
+        return 1;
+    }
+
+    if ((header.magic != MOVIE_MAGIC) || (header.version != MOVIE_VERSION) ||
+        (header.header_size != sizeof(movie_header_t)))
+    {
+        Debug_Log("%s(): Invalid header: %s", __func__, path);
+        fclose(f);
+        return 1;
+    }
+
+    // Add one element so that empty movies don't call malloc(0)
+    movie_frames = malloc((header.num_frames + 1) * sizeof(uint16_t));
+    if (movie_frames == NULL)
+    {
+        Debug_Log("%s(): Not enough memory", __func__);
+        fclose(f);
+        return 1;
+    }
+
+    if (fread(movie_frames, sizeof(uint16_t), header.num_frames, f)
+        != header.num_frames)
+    {
+        Debug_Log("%s(): File too short: %s", __func__, path);
+        free(movie_frames);
+        movie_frames = NULL;
+        fclose(f);
+        return 1;
+    }
+
+    fclose(f);
+
+    movie_num_frames = header.num_frames;
+    movie_expected_hash = header.frame_hash;
+    movie_exit_at_end = exit_at_end;
+
+    // Start with all keys released, the live input is ignored from now on
+    REG_KEYINPUT = KEYINPUT_MASK;
+
+    Movie_Begin(MOVIE_PLAYING);
+
+    return 0;
+}
+
+int Movie_IsRecording(void)
+{
+    return movie_state == MOVIE_RECORDING;
+}
+
+int Movie_IsPlaying(void)
+{
+    return movie_state == MOVIE_PLAYING;
+}
+
+void Movie_HandleFrame(void)
+{
+    if (movie_state == MOVIE_NONE)
+        return;
+
+    if (movie_state == MOVIE_PLAYING)
+    {
+        if (movie_current_frame == movie_num_frames)
+        {
+            Movie_End();
+            return;
+        }
+    }
+
+    movie_frame_hash = Movie_HashFrame(movie_frame_hash);
+
+    if (movie_state == MOVIE_RECORDING)
+    {
+        uint16_t keys = REG_KEYINPUT & KEYINPUT_MASK;
+
+        if (fwrite(&keys, sizeof(keys), 1, movie_file) != 1)
+        {
+            Debug_Log("%s(): Failed to write data.", __func__);
+            Movie_End();
+            return;
+        }
+    }
+    else // if (movie_state == MOVIE_PLAYING)
+    {
+        REG_KEYINPUT = movie_frames[movie_current_frame];
+    }
+
+    movie_current_frame++;
+}
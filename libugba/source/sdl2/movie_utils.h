@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: LGPL-3.0-only
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+#ifndef SDL2_MOVIE_UTILS_H__
+#define SDL2_MOVIE_UTILS_H__
+
+// A movie file stores the state of the keys (REG_KEYINPUT) of each frame. When
+// a movie is replayed, the emulation runs as fast as possible and the result
+// doesn't depend on the host, so it can be used for benchmarks and to check
+// that the output of a program hasn't changed.
+
+// Start recording the input to a movie file. If the path is NULL, it defaults
+// to "movie.ugbm". Returns 0 on success.
+int Movie_RecordStart(const char *path);
+
+// Start replaying the input from a movie file. If exit_at_end is 1, the program
+// exits when the movie ends. Returns 0 on success.
+int Movie_PlayStart(const char *path, int exit_at_end);
+
+// Stop recording or replaying a movie. A summary with the number of frames,
+// the time elapsed and the hash of all the frames is printed.
+void Movie_End(void);
+
+int Movie_IsRecording(void);
+int Movie_IsPlaying(void);
+
+// Called by the game thread once per frame, after the input of the frame has
+// been set. It records the input or overwrites it with the one in the movie.
+void Movie_HandleFrame(void);
+
+#endif // SDL2_MOVIE_UTILS_H__
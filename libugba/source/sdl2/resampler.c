@@ -0,0 +1,297 @@
+// SPDX-License-Identifier: LGPL-3.0-only
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+#include <math.h>
+#include <string.h>
+
+#include "debug_utils.h"
+#include "resampler.h"
+#include "simd.h"
+
+#define PI  (3.14159265358979323846)
+
+// Coefficients are stored in Q14 format so that the sum of two products fits
+// in a signed 32-bit integer even with the biggest coefficients.
+#define COEF_SHIFT  (14)
+#define COEF_ONE    (1 << COEF_SHIFT)
+
+// Dot product of two vectors of 16-bit values. The length must be a multiple
+// of 8.
+static inline int32_t Resampler_Dot(const int16_t *a, const int16_t *b, int n)
+{
+#if defined(UGBA_SSE2)
+    __m128i acc = _mm_setzero_si128();
+
+    for (int i = 0; i < n; i += 8)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *)&a[i]);
+        __m128i vb = _mm_loadu_si128((const __m128i *)&b[i]);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(va, vb));
+    }
+
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return _mm_cvtsi128_si32(acc);
+#elif defined(UGBA_NEON)
+    int32x4_t acc = vdupq_n_s32(0);
+
+    for (int i = 0; i < n; i += 8)
+    {
+        acc = vmlal_s16(acc, vld1_s16(&a[i]), vld1_s16(&b[i]));
+        acc = vmlal_s16(acc, vld1_s16(&a[i + 4]), vld1_s16(&b[i + 4]));
+    }
+
+    int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    sum = vpadd_s32(sum, sum);
+
+    return vget_lane_s32(sum, 0);
+#else
+    int32_t acc = 0;
+
+    for (int i = 0; i < n; i++)
+        acc += (int32_t)a[i] * (int32_t)b[i];
+
+    return acc;
+#endif
+}
+
+static inline int16_t Resampler_Saturate(int32_t value)
+{
+    if (value > INT16_MAX)
+        return INT16_MAX;
+    if (value < INT16_MIN)
+        return INT16_MIN;
+    return (int16_t)value;
+}
+
+// Blackman window. x goes from -1.0 to 1.0
+static double Resampler_Window(double x)
+{
+    if ((x <= -1.0) || (x >= 1.0))
+        return 0.0;
+
+    return 0.42 + 0.5 * cos(PI * x) + 0.08 * cos(2.0 * PI * x);
+}
+
+static double Resampler_Sinc(double x)
+{
+    if (fabs(x) < 1e-9)
+        return 1.0;
+
+    return sin(PI * x) / (PI * x);
+}
+
+static void Resampler_GenerateCoefficients(resampler_t *r, double cutoff)
+{
+    int taps = r->taps;
+    int half = taps / 2;
+
+    for (int phase = 0; phase <= RESAMPLER_PHASES; phase++)
+    {
+        int16_t *row = &r->coefs[phase * RESAMPLER_MAX_TAPS];
+
+        double frac = (double)phase / (double)RESAMPLER_PHASES;
+
+        double values[RESAMPLER_MAX_TAPS];
+        double total = 0.0;
+
+        for (int k = 0; k < taps; k++)
+        {
+            // Distance from the output position to this input frame
+            double t = (double)(k - (half - 1)) - frac;
+
+            values[k] = cutoff * Resampler_Sinc(cutoff * t)
+                      * Resampler_Window(t / (double)half);
+            total += values[k];
+        }
+
+        // Normalize every phase so that the gain at DC is exactly 1.0
+        int sum = 0;
+        int biggest = 0;
+
+        for (int k = 0; k < taps; k++)
+        {
+            row[k] = (int16_t)lround(values[k] * COEF_ONE / total);
+            sum += row[k];
+            if (row[k] > row[biggest])
+                biggest = k;
+        }
+
+        row[biggest] += COEF_ONE - sum;
+    }
+}
+
+void Resampler_Reset(resampler_t *r)
+{
+    int half = r->taps / 2;
+
+    // Start with enough silence before the first frame that it can be placed
+    // at the center of the filter.
+    r->frames = half - 1;
+    r->pos = (uint64_t)(half - 1) << 32;
+
+    memset(r->history, 0, sizeof(r->history));
+}
+
+int Resampler_Init(resampler_t *r, resampler_quality quality,
+                   uint32_t in_rate, uint32_t out_rate)
+{
+    if ((in_rate == 0) || (out_rate == 0))
+    {
+        Debug_Log("%s(): Invalid sample rates: %u -> %u", __func__,
+                  in_rate, out_rate);
+        return -1;
+    }
+
+    r->quality = quality;
+
+    double cutoff;
+
+    switch (quality)
+    {
+        case RESAMPLER_FIR_8:
+            r->taps = 8;
+            cutoff = 0.80;
+            break;
+        case RESAMPLER_FIR_32:
+            r->taps = 32;
+            cutoff = 0.90;
+            break;
+        case RESAMPLER_LINEAR:
+        case RESAMPLER_QUALITY_NUMBER:
+        default:
+            r->quality = RESAMPLER_LINEAR;
+            r->taps = 2;
+            cutoff = 1.0;
+            break;
+    }
+
+    // When the output rate is lower, the cutoff frequency needs to be below
+    // the Nyquist frequency of the output.
+    if (out_rate < in_rate)
+        cutoff = cutoff * (double)out_rate / (double)in_rate;
+
+    if (r->quality != RESAMPLER_LINEAR)
+        Resampler_GenerateCoefficients(r, cutoff);
+
+    r->step_base = ((uint64_t)in_rate << 32) / out_rate;
+    r->step = r->step_base;
+
+    Resampler_Reset(r);
+
+    return 0;
+}
+
+void Resampler_SetAdjust(resampler_t *r, double adjust)
+{
+    r->step = (uint64_t)((double)r->step_base * (1.0 + adjust));
+}
+
+uint32_t Resampler_Process(resampler_t *r, const int16_t *in,
+                           uint32_t in_frames, int16_t *out, uint32_t out_max)
+{
+    const uint32_t capacity = RESAMPLER_MAX_TAPS + RESAMPLER_BLOCK_FRAMES;
+
+    uint32_t taps = r->taps;
+    uint32_t half = taps / 2;
+
+    uint32_t out_frames = 0;
+
+    while (in_frames > 0)
+    {
+        // Append a block of input to the history
+
+        uint32_t chunk = capacity - r->frames;
+        if (chunk > in_frames)
+            chunk = in_frames;
+
+        int16_t *left = &r->history[0][r->frames];
+        int16_t *right = &r->history[1][r->frames];
+
+        for (uint32_t i = 0; i < chunk; i++)
+        {
+            left[i] = in[i * 2];
+            right[i] = in[i * 2 + 1];
+        }
+
+        r->frames += chunk;
+        in += chunk * 2;
+        in_frames -= chunk;
+
+        // Generate all output frames that have all their input available
+
+        while (((r->pos >> 32) + half) < r->frames)
+        {
+            if (out_frames == out_max)
+            {
+                // Drop the rest of the input
+                r->pos = (uint64_t)(r->frames - half) << 32;
+                in_frames = 0;
+                break;
+            }
+
+            uint32_t base = (r->pos >> 32) - (half - 1);
+
+            const int16_t *l = &r->history[0][base];
+            const int16_t *ri = &r->history[1][base];
+
+            if (r->quality == RESAMPLER_LINEAR)
+            {
+                int32_t frac = (r->pos >> 17) & 0x7FFF;
+
+                int32_t diff_l = (int32_t)l[1] - (int32_t)l[0];
+                int32_t diff_r = (int32_t)ri[1] - (int32_t)ri[0];
+
+                out[out_frames * 2] = (int16_t)(l[0] + ((diff_l * frac) >> 15));
+                out[out_frames * 2 + 1] =
+                        (int16_t)(ri[0] + ((diff_r * frac) >> 15));
+            }
+            else
+            {
+                uint64_t frac = r->pos & 0xFFFFFFFF;
+                uint32_t phase = (frac * RESAMPLER_PHASES + (1ULL << 31)) >> 32;
+
+                const int16_t *row = &r->coefs[phase * RESAMPLER_MAX_TAPS];
+
+                int32_t acc_l = Resampler_Dot(l, row, taps);
+                int32_t acc_r = Resampler_Dot(ri, row, taps);
+
+                const int32_t round = 1 << (COEF_SHIFT - 1);
+
+                out[out_frames * 2] =
+                        Resampler_Saturate((acc_l + round) >> COEF_SHIFT);
+                out[out_frames * 2 + 1] =
+                        Resampler_Saturate((acc_r + round) >> COEF_SHIFT);
+            }
+
+            out_frames++;
+            r->pos += r->step;
+        }
+
+        // Remove the frames that won't be needed anymore
+
+        uint32_t index = r->pos >> 32;
+        uint32_t discard = 0;
+        if (index > (half - 1))
+            discard = index - (half - 1);
+        if (discard > r->frames)
+            discard = r->frames;
+
+        if (discard > 0)
+        {
+            uint32_t keep = r->frames - discard;
+
+            memmove(&r->history[0][0], &r->history[0][discard],
+                    keep * sizeof(int16_t));
+            memmove(&r->history[1][0], &r->history[1][discard],
+                    keep * sizeof(int16_t));
+
+            r->frames = keep;
+            r->pos -= (uint64_t)discard << 32;
+        }
+    }
+
+    return out_frames;
+}
@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: LGPL-3.0-only
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+#ifndef SDL2_RESAMPLER_H__
+#define SDL2_RESAMPLER_H__
+
+#include <stdint.h>
+
+// Polyphase resampler of stereo 16-bit samples. It is used to convert the
+// output of the GBA to the sample rate of the audio device and of WAV files.
+
+typedef enum {
+    RESAMPLER_LINEAR,   // Linear interpolation
+    RESAMPLER_FIR_8,    // Windowed sinc, 8 taps
+    RESAMPLER_FIR_32,   // Windowed sinc, 32 taps
+
+    RESAMPLER_QUALITY_NUMBER
+} resampler_quality;
+
+#define RESAMPLER_PHASES        (256)
+#define RESAMPLER_MAX_TAPS      (32)
+#define RESAMPLER_BLOCK_FRAMES  (1024)
+
+typedef struct {
+    resampler_quality quality;
+    int taps;
+
+    uint64_t step_base; // 32.32 fixed point input frames per output frame
+    uint64_t step;
+    uint64_t pos; // 32.32 fixed point position in the history buffer
+
+    uint32_t frames; // Number of frames in the history buffer
+    int16_t history[2][RESAMPLER_MAX_TAPS + RESAMPLER_BLOCK_FRAMES];
+
+    // Filter coefficients for each phase (Q14)
+    int16_t coefs[(RESAMPLER_PHASES + 1) * RESAMPLER_MAX_TAPS];
+} resampler_t;
+
+// Both sample rates must be non-zero. Returns 0 on success. On error it returns
+// -1 and the resampler is left unchanged.
+int Resampler_Init(resampler_t *r, resampler_quality quality,
+                   uint32_t in_rate, uint32_t out_rate);
+
+// Clear the history of samples without changing the configuration
+void Resampler_Reset(resampler_t *r);
+
+// Change the ratio of the conversion slightly. The number of input frames used
+// for each output frame is multiplied by (1.0 + adjust).
+void Resampler_SetAdjust(resampler_t *r, double adjust);
+
+// Resample interleaved stereo frames. Returns the number of output frames. If
+// out_max is reached, the remaining input frames are dropped.
+uint32_t Resampler_Process(resampler_t *r, const int16_t *in,
+                           uint32_t in_frames, int16_t *out, uint32_t out_max);
+
+#endif // SDL2_RESAMPLER_H__
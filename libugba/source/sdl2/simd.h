@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: LGPL-3.0-only
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+#ifndef SDL2_SIMD_H__
+#define SDL2_SIMD_H__
+
+// Detect the vector instructions that can be used. SSE2 is always available in
+// x86_64 CPUs, and NEON in AArch64 CPUs. Code that uses them must always have a
+// scalar fallback for other CPUs.
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+# define UGBA_SSE2
+# include <emmintrin.h>
+#elif defined(__ARM_NEON)
+# define UGBA_NEON
+# include <arm_neon.h>
+#endif
+
+#endif // SDL2_SIMD_H__
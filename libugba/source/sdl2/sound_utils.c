@@ -11,47 +11,260 @@
 
 #include "debug_utils.h"
 #include "input_utils.h"
+#include "resampler.h"
 #include "sound_utils.h"
 
 #define SDL_BUFFER_SAMPLES              (1024)
 
-// Number of samples to have as max in the SDL sound buffer.
-#define SDL_BUFFER_SAMPLES_THRESHOLD   (SDL_BUFFER_SAMPLES * 6)
+// Limits of the size of the buffer of the device in automatic mode
+#define SDL_BUFFER_SAMPLES_AUTO_MIN     (256)
+#define SDL_BUFFER_SAMPLES_AUTO_MAX     (4096)
+
+// If the game hasn't sent any samples for this long, underruns are expected
+// and they don't mean that the buffer is too small.
+#define SOUND_IDLE_TICKS                (100)
+
+// Maximum deviation of the resampling ratio from the nominal ratio that is
+// used to keep the ring buffer at the target fill level.
+#define SOUND_MAX_RATE_DELTA            (0.005)
 
 static int sound_enabled = 0;
+static int sound_opened = 0;
 
 static SDL_AudioSpec obtained_spec;
-static SDL_AudioStream *stream;
 
-static void emulate_sound_callback(Uint8 *buffer, int len)
+static int buffer_samples = SDL_BUFFER_SAMPLES;
+static int buffer_auto = 0;
+static int latency_target_ms = 0; // 0 = Automatic
+
+// Ring buffer
+// ===========
+//
+// The game thread is the only writer and the audio callback is the only
+// reader, so the buffer doesn't need a lock. The positions are free-running
+// counters of stereo frames: the writer only updates write_pos and the reader
+// only updates read_pos.
+//
+// Every write also saves a timestamp with the position of the end of the data
+// written, which is used by the reader to measure the latency.
+
+#define RING_FRAMES     (8 * 1024) // Must be a power of two
+#define RING_MASK       (RING_FRAMES - 1)
+
+static int16_t ring_buffer[RING_FRAMES * 2];
+static SDL_atomic_t ring_write_pos;
+static SDL_atomic_t ring_read_pos;
+
+#define STAMP_COUNT     (64) // Must be a power of two
+#define STAMP_MASK      (STAMP_COUNT - 1)
+
+typedef struct {
+    uint32_t end_pos;
+    Uint64 counter;
+} ring_stamp_t;
+
+static ring_stamp_t ring_stamps[STAMP_COUNT];
+static SDL_atomic_t ring_stamp_write;
+static uint32_t ring_stamp_read; // Only used by the reader
+
+static uint32_t Ring_UsedFrames(void)
 {
-    int available = SDL_AudioStreamAvailable(stream);
+    uint32_t write_pos = (uint32_t)SDL_AtomicGet(&ring_write_pos);
+    uint32_t read_pos = (uint32_t)SDL_AtomicGet(&ring_read_pos);
 
-    if (available < len)
+    return write_pos - read_pos;
+}
+
+// Only called when the audio device is closed
+static void Ring_Reset(void)
+{
+    SDL_AtomicSet(&ring_write_pos, 0);
+    SDL_AtomicSet(&ring_read_pos, 0);
+    SDL_AtomicSet(&ring_stamp_write, 0);
+    ring_stamp_read = 0;
+}
+
+// Only called from the game thread. Returns the number of frames written.
+static uint32_t Ring_Write(const int16_t *buffer, uint32_t frames)
+{
+    uint32_t write_pos = (uint32_t)SDL_AtomicGet(&ring_write_pos);
+    uint32_t read_pos = (uint32_t)SDL_AtomicGet(&ring_read_pos);
+
+    uint32_t free_frames = RING_FRAMES - (write_pos - read_pos);
+    if (frames > free_frames)
+        frames = free_frames;
+
+    if (frames == 0)
+        return 0;
+
+    for (uint32_t i = 0; i < frames; i++)
     {
-        memset(buffer, 0, len);
+        uint32_t index = (write_pos + i) & RING_MASK;
+        ring_buffer[index * 2] = buffer[i * 2];
+        ring_buffer[index * 2 + 1] = buffer[i * 2 + 1];
     }
-    else
+
+    uint32_t stamp = (uint32_t)SDL_AtomicGet(&ring_stamp_write);
+    ring_stamps[stamp & STAMP_MASK].end_pos = write_pos + frames;
+    ring_stamps[stamp & STAMP_MASK].counter = SDL_GetPerformanceCounter();
+
+    // Make sure that the data is visible before the new write position
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&ring_stamp_write, (int)(stamp + 1));
+    SDL_AtomicSet(&ring_write_pos, (int)(write_pos + frames));
+
+    return frames;
+}
+
+// Only called from the audio callback. Returns the time at which the frame at
+// the current read position was written, or 0 if it isn't known.
+static Uint64 Ring_ReadTimestamp(void)
+{
+    uint32_t read_pos = (uint32_t)SDL_AtomicGet(&ring_read_pos);
+    uint32_t stamp_write = (uint32_t)SDL_AtomicGet(&ring_stamp_write);
+    SDL_MemoryBarrierAcquire();
+
+    // Skip the stamps of data that has already been read
+    while (ring_stamp_read != stamp_write)
     {
-        int obtained = SDL_AudioStreamGet(stream, buffer, len);
-        if (obtained == -1)
-        {
-            Debug_Log("Failed to get converted data: %s", SDL_GetError());
-        }
-        else
+        ring_stamp_t *stamp = &ring_stamps[ring_stamp_read & STAMP_MASK];
+
+        if ((int32_t)(stamp->end_pos - read_pos) > 0)
+            return stamp->counter;
+
+        ring_stamp_read++;
+    }
+
+    return 0;
+}
+
+// Only called from the audio callback. Returns the number of frames read.
+static uint32_t Ring_Read(int16_t *buffer, uint32_t frames)
+{
+    uint32_t write_pos = (uint32_t)SDL_AtomicGet(&ring_write_pos);
+    SDL_MemoryBarrierAcquire();
+    uint32_t read_pos = (uint32_t)SDL_AtomicGet(&ring_read_pos);
+
+    uint32_t used_frames = write_pos - read_pos;
+    if (frames > used_frames)
+        frames = used_frames;
+
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        uint32_t index = (read_pos + i) & RING_MASK;
+        buffer[i * 2] = ring_buffer[index * 2];
+        buffer[i * 2 + 1] = ring_buffer[index * 2 + 1];
+    }
+
+    // Make sure that the data has been read before releasing it
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&ring_read_pos, (int)(read_pos + frames));
+
+    return frames;
+}
+
+// Only called from the audio callback
+static void Ring_Clear(void)
+{
+    SDL_AtomicSet(&ring_read_pos, SDL_AtomicGet(&ring_write_pos));
+}
+
+// Resampler
+// =========
+//
+// The resampler converts the samples from GBA_SAMPLERATE to the sample rate of
+// the device. The ratio is adjusted slightly every time new samples are sent so
+// that the amount of audio in the ring buffer stays close to the target. This
+// absorbs the difference between the speed of the emulation and the speed at
+// which the device consumes samples without dropping samples.
+
+#define RESAMPLE_BUFFER_FRAMES  (4 * 1024)
+
+static int16_t resample_buffer[RESAMPLE_BUFFER_FRAMES * 2];
+
+static resampler_t resampler;
+static resampler_quality resampler_mode = RESAMPLER_FIR_8;
+
+static uint32_t target_frames;
+
+static double Sound_ResampleAdjust(void)
+{
+    double delta = ((double)Ring_UsedFrames() - (double)target_frames)
+                 / (double)target_frames;
+
+    if (delta > 1.0)
+        delta = 1.0;
+    else if (delta < -1.0)
+        delta = -1.0;
+
+    // If the buffer is fuller than the target, advance faster through the
+    // input so that fewer samples are generated.
+    return delta * SOUND_MAX_RATE_DELTA;
+}
+
+// Latency statistics
+// ==================
+//
+// They are only updated by the audio callback. Other threads need to lock the
+// audio device to read them.
+
+static sound_latency_stats latency;
+static double latency_total_ms;
+
+static SDL_atomic_t underrun_count;
+static int underrun_count_handled; // Only used by the game thread
+static int callback_primed; // Set when the buffer reaches the target
+
+static void Sound_LatencyUpdate(Uint64 stamp)
+{
+    if (stamp == 0)
+        return;
+
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now < stamp)
+        return;
+
+    Uint64 elapsed = now - stamp;
+
+    double elapsed_ms = (double)elapsed * 1000.0
+                      / (double)SDL_GetPerformanceFrequency();
+
+    latency.callbacks++;
+    latency.last_ms = elapsed_ms;
+    if (elapsed_ms > latency.max_ms)
+        latency.max_ms = elapsed_ms;
+
+    latency_total_ms += elapsed_ms;
+    latency.average_ms = latency_total_ms / (double)latency.callbacks;
+}
+
+// Audio callback
+// ==============
+
+static void emulate_sound_callback(Uint8 *buffer, int len)
+{
+    uint32_t frames = len / (2 * sizeof(int16_t));
+
+    if (Ring_UsedFrames() >= target_frames)
+        callback_primed = 1;
+
+    Sound_LatencyUpdate(Ring_ReadTimestamp());
+
+    uint32_t obtained = Ring_Read((int16_t *)buffer, frames);
+    if (obtained < frames)
+    {
+        // Clear the rest of the buffer
+        size_t offset = obtained * 2 * sizeof(int16_t);
+        memset(&(buffer[offset]), 0, len - offset);
+
+        // Underruns before the buffer has been filled for the first time
+        // don't mean anything.
+        if (callback_primed)
         {
-            if (obtained != len)
-            {
-                Debug_Log("%s: Obtained = %d, Requested = %d", __func__,
-                          obtained, len);
-                // Clear the rest of the buffer
-                memset(&(buffer[obtained]), 0, len - obtained);
-            }
+            SDL_AtomicAdd(&underrun_count, 1);
+            latency.underruns++;
         }
     }
-
-    //Debug_Log("Available: %d/%d",
-    //          SDL_AudioStreamAvailable(stream), obtained_spec.samples);
 }
 
 static void sound_callback(UNUSED void *userdata, Uint8 *buffer, int len)
@@ -63,7 +276,9 @@ static void sound_callback(UNUSED void *userdata, Uint8 *buffer, int len)
         memset(buffer, 0, len);
         // Clear all the samples sent from the GBA so that they don't just stay
         // in the buffer.
-        SDL_AudioStreamClear(stream);
+        Ring_Clear();
+        // The buffer has to be filled again before counting underruns
+        callback_primed = 0;
     }
     else
     {
@@ -71,32 +286,68 @@ static void sound_callback(UNUSED void *userdata, Uint8 *buffer, int len)
     }
 }
 
-static void Sound_End(void)
+// Device management
+// =================
+
+static void Sound_UpdateTarget(void)
+{
+    int freq = sound_opened ? obtained_spec.freq : SDL_SAMPLERATE;
+    int samples = sound_opened ? obtained_spec.samples : buffer_samples;
+
+    // The buffer needs to hold at least what the device requests in one
+    // callback plus the samples of one frame of the game.
+    uint32_t frame_frames = freq / 60;
+    uint32_t min_frames = samples + frame_frames;
+    uint32_t max_frames = RING_FRAMES / 2;
+
+    uint32_t frames;
+
+    if (latency_target_ms > 0)
+        frames = (uint32_t)(((int64_t)freq * latency_target_ms) / 1000);
+    else
+        frames = samples + 2 * frame_frames;
+
+    if (frames < min_frames)
+        frames = min_frames;
+    if (frames > max_frames)
+        frames = max_frames;
+
+    target_frames = frames;
+}
+
+static void Sound_CloseDevice(void)
 {
-     SDL_FreeAudioStream(stream);
+    if (sound_opened == 0)
+        return;
+
+    SDL_CloseAudio();
 
-     sound_enabled = 0;
+    sound_opened = 0;
 }
 
-void Sound_Init(void)
+static int Sound_OpenDevice(void)
 {
-    sound_enabled = 0;
+    Sound_CloseDevice();
 
     SDL_AudioSpec desired_spec;
 
     desired_spec.freq = SDL_SAMPLERATE;
     desired_spec.format = AUDIO_S16SYS;
     desired_spec.channels = 2;
-    desired_spec.samples = SDL_BUFFER_SAMPLES;
+    desired_spec.samples = buffer_samples;
     desired_spec.callback = sound_callback;
     desired_spec.userdata = NULL;
 
-    if (SDL_OpenAudio(&desired_spec, &obtained_spec) < 0)
+    // Don't let SDL change the format, the ring buffer holds samples in the
+    // format of the device.
+    if (SDL_OpenAudio(&desired_spec, NULL) < 0)
     {
         Debug_Log("Couldn't open audio: %s", SDL_GetError());
-        return;
+        return 1;
     }
 
+    obtained_spec = desired_spec;
+
     Debug_Log("Audio information:\n"
               "    Freq: %d\n"
               "    Channels: %d\n"
@@ -105,37 +356,178 @@ void Sound_Init(void)
               obtained_spec.channels,
               obtained_spec.samples);
 
-    // Input format is int16_t, dual, 32 * 1024 Hz
-    // Output format is whatever SDL_OpenAudio() returned
-    stream = SDL_NewAudioStream(AUDIO_S16, 2, GBA_SAMPLERATE,
-                                obtained_spec.format, obtained_spec.channels,
-                                obtained_spec.freq);
-    if (stream == NULL) {
-        Debug_Log("Failed to create audio stream: %s", SDL_GetError());
+    Ring_Reset();
+
+    Resampler_Init(&resampler, resampler_mode, GBA_SAMPLERATE,
+                   obtained_spec.freq);
+
+    memset(&latency, 0, sizeof(latency));
+    latency_total_ms = 0.0;
+    callback_primed = 0;
+    SDL_AtomicSet(&underrun_count, 0);
+    underrun_count_handled = 0;
+
+    sound_opened = 1;
+
+    Sound_UpdateTarget();
+
+    SDL_PauseAudio(0);
+
+    return 0;
+}
+
+static void Sound_End(void)
+{
+    Sound_CloseDevice();
+
+    sound_enabled = 0;
+}
+
+void Sound_SetLatencyTarget(int ms)
+{
+    if (ms < 0)
+        ms = 0;
+
+    latency_target_ms = ms;
+
+    if (sound_opened)
+    {
+        SDL_LockAudio();
+        Sound_UpdateTarget();
+        SDL_UnlockAudio();
+    }
+}
+
+void Sound_SetBufferSamples(int samples)
+{
+    if (samples <= 0)
+    {
+        buffer_auto = 1;
+        samples = SDL_BUFFER_SAMPLES_AUTO_MIN;
+    }
+    else
+    {
+        buffer_auto = 0;
+    }
+
+    buffer_samples = samples;
+
+    if (sound_opened)
+        Sound_OpenDevice();
+}
+
+void Sound_SetResamplerQuality(resampler_quality quality)
+{
+    resampler_mode = quality;
+
+    if (sound_opened)
+    {
+        Resampler_Init(&resampler, resampler_mode, GBA_SAMPLERATE,
+                       obtained_spec.freq);
+    }
+}
+
+// In automatic mode, make the buffer of the device bigger if the audio callback
+// has run out of data while the game was sending samples.
+static void Sound_HandleAutoBuffer(void)
+{
+    static Uint32 last_send_ticks = 0;
+
+    Uint32 ticks = SDL_GetTicks();
+    int count = SDL_AtomicGet(&underrun_count);
+
+    int idle = (ticks - last_send_ticks) > SOUND_IDLE_TICKS;
+
+    last_send_ticks = ticks;
+
+    if (count == underrun_count_handled)
+        return;
+
+    underrun_count_handled = count;
+
+    if (idle || (buffer_samples >= SDL_BUFFER_SAMPLES_AUTO_MAX))
+        return;
+
+    buffer_samples *= 2;
+
+    Debug_Log("%s(): Underrun, new buffer size: %d", __func__, buffer_samples);
+
+    Sound_OpenDevice();
+}
+
+void Sound_GetLatencyStats(sound_latency_stats *stats)
+{
+    if (sound_opened == 0)
+    {
+        memset(stats, 0, sizeof(sound_latency_stats));
         return;
     }
 
+    SDL_LockAudio();
+    *stats = latency;
+    SDL_UnlockAudio();
+
+    stats->buffer_samples = obtained_spec.samples;
+    stats->target_frames = target_frames;
+}
+
+void Sound_ResetLatencyStats(void)
+{
+    if (sound_opened == 0)
+        return;
+
+    SDL_LockAudio();
+    memset(&latency, 0, sizeof(latency));
+    latency_total_ms = 0.0;
+    SDL_UnlockAudio();
+}
+
+void Sound_Init(void)
+{
+    sound_enabled = 0;
+
+    if (Sound_OpenDevice() != 0)
+        return;
+
     // Cleanup everything on exit of the program
     atexit(Sound_End);
 
     sound_enabled = 1;
-
-    SDL_PauseAudio(0);
 }
 
-int Sound_IsBufferOverThreshold(void)
+int Sound_OutputIsActive(void)
 {
-    if (SDL_AudioStreamAvailable(stream) > SDL_BUFFER_SAMPLES_THRESHOLD)
-        return 1;
+    if ((sound_opened == 0) || (sound_enabled == 0))
+        return 0;
 
-    return 0;
+    // During speedup the callback discards all samples
+    if (Input_Speedup_Enabled())
+        return 0;
+
+    return 1;
 }
 
 void Sound_SendSamples(int16_t *buffer, int len)
 {
-    int rc = SDL_AudioStreamPut(stream, buffer, len);
-    if (rc == -1)
-        Debug_Log("Failed to send samples to stream: %s", SDL_GetError());
+    if (sound_opened == 0)
+        return;
+
+    if (buffer_auto)
+        Sound_HandleAutoBuffer();
+
+    uint32_t in_frames = len / (2 * sizeof(int16_t));
+    if (in_frames == 0)
+        return;
+
+    Resampler_SetAdjust(&resampler, Sound_ResampleAdjust());
+
+    uint32_t out_frames = Resampler_Process(&resampler, buffer, in_frames,
+                                            resample_buffer,
+                                            RESAMPLE_BUFFER_FRAMES);
+
+    // If the buffer is full (the audio callback isn't running or the game is
+    // running too fast) the samples that don't fit are dropped.
+    Ring_Write(resample_buffer, out_frames);
 }
 
 void Sound_Enable(void)
@@ -7,14 +7,48 @@
 
 #include <stdint.h>
 
+#include "resampler.h"
+
 #define GBA_SAMPLERATE      (32 * 1024)
 #define SDL_SAMPLERATE      (44100)
 
 void Sound_Init(void);
 
+// Returns 1 if the audio device is going to play the samples sent to it
+int Sound_OutputIsActive(void);
+
+// Send stereo samples at GBA_SAMPLERATE to the audio device. The size is in
+// bytes.
 void Sound_SendSamples(int16_t *buffer, int len);
 
-int Sound_IsBufferOverThreshold(void);
+// Set the amount of audio that is kept queued for the audio device, in
+// milliseconds. If ms is 0, it is calculated from the size of the buffer of the
+// device.
+void Sound_SetLatencyTarget(int ms);
+
+// Set the size of the buffer of the audio device, in samples. If it is 0, the
+// size starts small and it is increased every time the device runs out of
+// samples while the game is running.
+void Sound_SetBufferSamples(int samples);
+
+// Select the quality of the conversion from GBA_SAMPLERATE to the sample rate
+// of the device. It must be called from the game thread.
+void Sound_SetResamplerQuality(resampler_quality quality);
+
+typedef struct {
+    uint32_t callbacks; // Number of callbacks that have been measured
+    double last_ms;
+    double average_ms;
+    double max_ms;
+    uint32_t underruns;
+    int buffer_samples; // Current size of the buffer of the device
+    uint32_t target_frames; // Current target of queued samples
+} sound_latency_stats;
+
+// Statistics of the time between generating samples and sending them to the
+// audio device.
+void Sound_GetLatencyStats(sound_latency_stats *stats);
+void Sound_ResetLatencyStats(void);
 
 void Sound_Enable(void);
 void Sound_Disable(void);
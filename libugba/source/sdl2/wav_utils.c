@@ -1,13 +1,17 @@
 // SPDX-License-Identifier: LGPL-3.0-only
 //
-// Copyright (c) 2020 Antonio Niño Díaz
+// Copyright (c) 2020-2021 Antonio Niño Díaz
 
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "capture_io.h"
 #include "debug_utils.h"
-
+#include "resampler.h"
 #include "sound_utils.h"
+#include "wav_utils.h"
+
+#include "core/sound.h"
 
 // Information taken from:
 //
@@ -42,9 +46,14 @@ typedef struct {
 } wav_header_t;
 #pragma pack(pop)
 
-static FILE *wav_file;
+static capture_file *wav_file;
 static uint32_t wav_sample_rate;
 
+// Used when the sample rate of the file isn't GBA_SAMPLERATE
+static int wav_resample;
+static resampler_t wav_resampler;
+static int16_t wav_resample_buffer[RESAMPLER_BLOCK_FRAMES * 2 * 2];
+
 // Hardcode format to 16-bit (signed), two channels
 
 #define WAV_NUMBER_CHANNELS     (2)
@@ -56,10 +65,22 @@ void WAV_FileEnd(void)
     if (wav_file == NULL)
         return;
 
-    // Now that the final size is known, write the header
+    Sound_SinkRemove(WAV_FileStream);
 
-    fseek(wav_file, 0, SEEK_END);
-    long int size = ftell(wav_file);
+    // The resampler needs half of the length of the filter after each input
+    // frame to generate the output frame that corresponds to it. Flush the last
+    // frames by sending silence to it.
+    if (wav_resample)
+    {
+        int16_t silence[(RESAMPLER_MAX_TAPS / 2) * 2] = { 0 };
+
+        WAV_FileStream(silence, (wav_resampler.taps / 2) * 2 * sizeof(int16_t));
+    }
+
+    // Wait until all the samples have been written. Now that the final size is
+    // known, the header can be written.
+
+    uint32_t size = CaptureIO_Drain(wav_file) + sizeof(wav_header_t);
 
     wav_header_t header = {
         .chunk_id = 0x46464952,
@@ -79,14 +100,10 @@ void WAV_FileEnd(void)
         .subchunk_2_size = size - sizeof(wav_header_t),
     };
 
-    fseek(wav_file, 0, SEEK_SET);
-
-    if (fwrite(&header, sizeof(header), 1, wav_file) != 1)
-        Debug_Log("%s(): Can't write header.", __func__);
-
-    fclose(wav_file);
-
-    Debug_Log("%s: File saved. Size: %ld", __func__, size);
+    if (CaptureIO_Close(wav_file, &header, sizeof(header)) != 0)
+        Debug_Log("%s(): Failed to save file.", __func__);
+    else
+        Debug_Log("%s: File saved. Size: %u", __func__, size);
 
     wav_file = NULL;
 }
@@ -96,27 +113,39 @@ void WAV_FileStart(const char *path, uint32_t sample_rate)
     if (path == NULL)
         path = "audio.wav";
 
+    if ((sample_rate < WAV_SAMPLE_RATE_MIN) ||
+        (sample_rate > WAV_SAMPLE_RATE_MAX))
+    {
+        Debug_Log("%s(): Invalid sample rate: %u", __func__, sample_rate);
+        return;
+    }
+
     if (wav_file)
         WAV_FileEnd();
 
-    wav_file = fopen(path, "wb");
+    // The data is written to the file by a separate thread so that the disk
+    // never blocks the emulation. The header is written when the file is
+    // closed.
+    wav_file = CaptureIO_Open(path, sizeof(wav_header_t));
     if (wav_file == NULL)
-    {
-        Debug_Log("%s(): Can't open file for writing: %s", __func__, path);
         return;
-    }
 
-    wav_header_t header =  { 0 };
-    if (fwrite(&header, sizeof(header), 1, wav_file) != 1)
+    wav_sample_rate = sample_rate;
+
+    // There is no need to care about the cost of the conversion here, so use
+    // the best quality available.
+    wav_resample = (sample_rate != GBA_SAMPLERATE);
+    if (wav_resample)
     {
-        Debug_Log("%s(): Can't allocate space for header.", __func__);
-        return;
+        Resampler_Init(&wav_resampler, RESAMPLER_FIR_32, GBA_SAMPLERATE,
+                       sample_rate);
     }
 
-    wav_sample_rate = sample_rate;
-
     // Close file when the program exits
     atexit(WAV_FileEnd);
+
+    // Receive the samples generated every frame
+    Sound_SinkAdd(WAV_FileStream);
 }
 
 int WAV_FileIsOpen(void)
@@ -132,6 +161,36 @@ void WAV_FileStream(int16_t *buffer, size_t size)
     if (wav_file == NULL)
         return;
 
-    if (fwrite(buffer, size, 1, wav_file) != 1)
-        Debug_Log("%s(): Failed to write data.", __func__);
+    if (wav_resample)
+    {
+        uint32_t frames = size / (2 * sizeof(int16_t));
+        uint32_t max_frames = RESAMPLER_BLOCK_FRAMES / 4;
+
+        while (frames > 0)
+        {
+            // Convert the input in blocks small enough that the output always
+            // fits in the buffer.
+            uint32_t in_frames = frames > max_frames ? max_frames : frames;
+
+            uint32_t out_frames = Resampler_Process(&wav_resampler, buffer,
+                                                    in_frames,
+                                                    wav_resample_buffer,
+                                                    RESAMPLER_BLOCK_FRAMES * 2);
+
+            buffer += in_frames * 2;
+            frames -= in_frames;
+
+            if (out_frames == 0)
+                continue;
+
+            CaptureIO_Write(wav_file, wav_resample_buffer,
+                            out_frames * 2 * sizeof(int16_t));
+        }
+
+        return;
+    }
+
+    // If the writer thread can't keep up, the data is dropped and reported in
+    // the log.
+    CaptureIO_Write(wav_file, buffer, size);
 }
@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: LGPL-3.0-only
 //
-// Copyright (c) 2020 Antonio Niño Díaz
+// Copyright (c) 2020-2021 Antonio Niño Díaz
 
 #ifndef SDL2_WAV_UTILS_H__
 #define SDL2_WAV_UTILS_H__
@@ -8,6 +8,13 @@
 #include <stddef.h>
 #include <stdint.h>
 
+// Range of sample rates accepted by WAV_FileStart()
+#define WAV_SAMPLE_RATE_MIN     (8000)
+#define WAV_SAMPLE_RATE_MAX     (192000)
+
+// The samples passed to WAV_FileStream() are always at GBA_SAMPLERATE. If
+// sample_rate is different, they are converted before writing them. If
+// sample_rate is outside of the valid range, the file isn't created.
 void WAV_FileStart(const char *path, uint32_t sample_rate);
 void WAV_FileEnd(void);
 
@@ -0,0 +1,648 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+// Encoders shared by gbacomp and the tests of the BIOS decompression functions.
+// They generate data that can be decompressed by the BIOS functions
+// SWI_LZ77UnCompReadNormalWrite8bit(), SWI_LZ77UnCompReadNormalWrite16bit(),
+// SWI_RLUnCompWram(), SWI_RLUnCompVram() and SWI_HuffUnComp().
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compress.h"
+
+static size_t write_header(uint8_t *dst, size_t size, uint8_t type)
+{
+    uint32_t header = ((uint32_t)size << 8) | type;
+
+    dst[0] = header & 0xFF;
+    dst[1] = (header >> 8) & 0xFF;
+    dst[2] = (header >> 16) & 0xFF;
+    dst[3] = (header >> 24) & 0xFF;
+
+    return 4;
+}
+
+static size_t pad_size(uint8_t *dst, size_t size)
+{
+    while (size & 3)
+        dst[size++] = 0;
+
+    return size;
+}
+
+// LZ77
+// ====
+//
+// The data is parsed optimally: for each position the longest match is found,
+// and then the combination of literals and matches that generates the smallest
+// output is selected working backwards from the end of the data. A literal
+// costs 9 bits (8 bits plus the flag) and a match costs 17 bits. When there is
+// a tie, longer matches are preferred because they are faster to decompress.
+//
+// When the output is VRAM the BIOS writes 16 bits at a time, so a match can't
+// reference the byte right before the current one, as it hasn't been written
+// yet.
+
+#define LZ77_HASH_BITS      (16)
+#define LZ77_MAX_DISTANCE   (4096)
+#define LZ77_MIN_MATCH      (3)
+#define LZ77_MAX_MATCH      (18)
+#define LZ77_MAX_CHAIN      (4096)
+
+#define LZ77_COST_LITERAL   (9)
+#define LZ77_COST_MATCH     (17)
+
+static uint32_t lz77_hash(const uint8_t *p)
+{
+    uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return (v * 2654435761U) >> (32 - LZ77_HASH_BITS);
+}
+
+size_t compress_lz77(const uint8_t *src, size_t size, uint8_t *dst, int vram)
+{
+    size_t min_distance = vram ? 2 : 1;
+
+    int32_t *head = malloc((1 << LZ77_HASH_BITS) * sizeof(int32_t));
+    int32_t *prev = malloc(size * sizeof(int32_t) + 1);
+    uint8_t *match_len = malloc(size + 1);
+    uint16_t *match_dist = malloc(size * sizeof(uint16_t) + 1);
+    uint32_t *cost = malloc((size + 1) * sizeof(uint32_t));
+    uint8_t *choice = malloc(size + 1);
+
+    size_t out = 0;
+
+    if ((head == NULL) || (prev == NULL) || (match_len == NULL) ||
+        (match_dist == NULL) || (cost == NULL) || (choice == NULL))
+        goto cleanup;
+
+    for (size_t i = 0; i < (1 << LZ77_HASH_BITS); i++)
+        head[i] = -1;
+
+    // Find the longest match for each position
+
+    for (size_t i = 0; i < size; i++)
+    {
+        match_len[i] = 0;
+        match_dist[i] = 0;
+
+        if (i + LZ77_MIN_MATCH > size)
+            continue;
+
+        size_t max_len = size - i;
+        if (max_len > LZ77_MAX_MATCH)
+            max_len = LZ77_MAX_MATCH;
+
+        uint32_t h = lz77_hash(&src[i]);
+        int32_t cand = head[h];
+
+        for (int chain = 0; chain < LZ77_MAX_CHAIN; chain++)
+        {
+            if ((cand < 0) || (i - cand > LZ77_MAX_DISTANCE))
+                break;
+
+            if (i - cand >= min_distance)
+            {
+                size_t len = 0;
+                while ((len < max_len) && (src[cand + len] == src[i + len]))
+                    len++;
+
+                if (len > match_len[i])
+                {
+                    match_len[i] = len;
+                    match_dist[i] = i - cand;
+
+                    if (len == max_len)
+                        break;
+                }
+            }
+
+            cand = prev[cand];
+        }
+
+        prev[i] = head[h];
+        head[h] = i;
+    }
+
+    // Calculate the cheapest way to encode the data from each position to the
+    // end of the data. Any length shorter than the longest match is valid too.
+
+    cost[size] = 0;
+
+    for (size_t i = size; i-- > 0; )
+    {
+        uint32_t best = LZ77_COST_LITERAL + cost[i + 1];
+        uint8_t best_choice = 1;
+
+        for (size_t len = LZ77_MIN_MATCH; len <= match_len[i]; len++)
+        {
+            uint32_t c = LZ77_COST_MATCH + cost[i + len];
+            if (c <= best)
+            {
+                best = c;
+                best_choice = len;
+            }
+        }
+
+        cost[i] = best;
+        choice[i] = best_choice;
+    }
+
+    // Generate output
+
+    out = write_header(dst, size, 0x10);
+
+    size_t i = 0;
+    while (i < size)
+    {
+        size_t flag_pos = out++;
+        uint8_t flag = 0;
+
+        for (int k = 0; k < 8; k++)
+        {
+            flag <<= 1;
+
+            if (i >= size)
+                continue;
+
+            size_t len = choice[i];
+
+            if (len >= LZ77_MIN_MATCH)
+            {
+                uint32_t info = ((len - 3) << 12) | (match_dist[i] - 1);
+                dst[out++] = info >> 8;
+                dst[out++] = info & 0xFF;
+                flag |= 1;
+            }
+            else
+            {
+                dst[out++] = src[i];
+            }
+
+            i += len;
+        }
+
+        dst[flag_pos] = flag;
+    }
+
+    out = pad_size(dst, out);
+
+cleanup:
+
+    free(head);
+    free(prev);
+    free(match_len);
+    free(match_dist);
+    free(cost);
+    free(choice);
+
+    return out;
+}
+
+// Run-length encoding
+// ===================
+
+size_t compress_rle(const uint8_t *src, size_t size, uint8_t *dst)
+{
+    size_t out = write_header(dst, size, 0x30);
+
+    size_t i = 0;
+    while (i < size)
+    {
+        size_t run = 1;
+        while ((i + run < size) && (src[i + run] == src[i]) && (run < 130))
+            run++;
+
+        if (run >= 3)
+        {
+            dst[out++] = 0x80 | (run - 3);
+            dst[out++] = src[i];
+            i += run;
+            continue;
+        }
+
+        // Copy literals until the next run of 3 bytes. Runs of 2 bytes are
+        // cheaper as literals.
+        size_t start = i;
+        while ((i < size) && (i - start < 128))
+        {
+            if ((i + 2 < size) && (src[i] == src[i + 1]) &&
+                (src[i] == src[i + 2]))
+                break;
+            i++;
+        }
+
+        dst[out++] = i - start - 1;
+        memcpy(&dst[out], &src[start], i - start);
+        out += i - start;
+    }
+
+    return pad_size(dst, out);
+}
+
+// Huffman
+// =======
+//
+// The tree used by the BIOS is stored as an array of nodes. Each internal node
+// stores the offset to its pair of children, but this offset only has 6 bits.
+// Trees with many symbols and very different frequencies may not fit in that
+// format. In that case, the maximum length of the codes is reduced until the
+// tree fits. A tree of 8 levels always fits.
+
+#define HUFF_MAX_SYMBOLS    (256)
+#define HUFF_MAX_NODES      (HUFF_MAX_SYMBOLS * 2)
+#define HUFF_MAX_LENGTH     (24)
+
+typedef struct {
+    uint32_t weight;
+    int child[2];
+    int symbol; // -1 for internal nodes
+} huff_node;
+
+static huff_node huff_nodes[HUFF_MAX_NODES];
+static int huff_num_nodes;
+
+// Work arrays. They are too big to be allocated in the stack.
+static int huff_active[HUFF_MAX_SYMBOLS];
+static int huff_pending[HUFF_MAX_NODES];
+static int huff_position[HUFF_MAX_NODES];
+
+static int huff_new_node(uint32_t weight, int child0, int child1, int symbol)
+{
+    huff_nodes[huff_num_nodes] = (huff_node){
+        weight, { child0, child1 }, symbol
+    };
+    return huff_num_nodes++;
+}
+
+static void huffman_depths(int node, int depth, int *length)
+{
+    if (huff_nodes[node].symbol >= 0)
+    {
+        length[huff_nodes[node].symbol] = depth;
+        return;
+    }
+
+    huffman_depths(huff_nodes[node].child[0], depth + 1, length);
+    huffman_depths(huff_nodes[node].child[1], depth + 1, length);
+}
+
+// Calculates the length of the code of each symbol. Unused symbols get 0.
+static void huffman_lengths(const uint32_t *freq, int num_symbols, int *length)
+{
+    int *active = huff_active;
+    int num_active = 0;
+
+    huff_num_nodes = 0;
+
+    for (int s = 0; s < num_symbols; s++)
+    {
+        length[s] = 0;
+        if (freq[s] > 0)
+            active[num_active++] = huff_new_node(freq[s], -1, -1, s);
+    }
+
+    // The tree needs at least two leaves
+    for (int s = 0; num_active < 2; s++)
+    {
+        if (freq[s] == 0)
+            active[num_active++] = huff_new_node(0, -1, -1, s);
+    }
+
+    // Merge the two lightest nodes until there is only one left
+    while (num_active > 1)
+    {
+        int a = 0, b = 1;
+        if (huff_nodes[active[b]].weight < huff_nodes[active[a]].weight)
+        {
+            a = 1;
+            b = 0;
+        }
+
+        for (int i = 2; i < num_active; i++)
+        {
+            uint32_t w = huff_nodes[active[i]].weight;
+            if (w < huff_nodes[active[a]].weight)
+            {
+                b = a;
+                a = i;
+            }
+            else if (w < huff_nodes[active[b]].weight)
+            {
+                b = i;
+            }
+        }
+
+        int node = huff_new_node(huff_nodes[active[a]].weight +
+                                 huff_nodes[active[b]].weight,
+                                 active[a], active[b], -1);
+
+        int lo = (a < b) ? a : b;
+        int hi = (a < b) ? b : a;
+        active[lo] = node;
+        active[hi] = active[--num_active];
+    }
+
+    huffman_depths(active[0], 0, length);
+}
+
+// Limits the length of the codes to the specified value while keeping a valid
+// prefix code, with the least frequent symbols getting the longest codes.
+static void huffman_limit_lengths(const uint32_t *freq, int num_symbols,
+                                  int *length, int limit)
+{
+    uint32_t max_kraft = 1U << limit;
+    uint32_t kraft = 0;
+
+    for (int s = 0; s < num_symbols; s++)
+    {
+        if (length[s] == 0)
+            continue;
+
+        if (length[s] > limit)
+            length[s] = limit;
+
+        kraft += 1U << (limit - length[s]);
+    }
+
+    // Make codes longer until the code is valid again
+
+    while (kraft > max_kraft)
+    {
+        int best = -1;
+
+        for (int s = 0; s < num_symbols; s++)
+        {
+            if ((length[s] == 0) || (length[s] == limit))
+                continue;
+
+            if ((best == -1) || (length[s] > length[best]) ||
+                ((length[s] == length[best]) && (freq[s] < freq[best])))
+                best = s;
+        }
+
+        kraft -= 1U << (limit - length[best] - 1);
+        length[best]++;
+    }
+
+    // Use any space left in the code to make frequent symbols shorter
+
+    int changed = 1;
+    while (changed)
+    {
+        changed = 0;
+
+        int best = -1;
+
+        for (int s = 0; s < num_symbols; s++)
+        {
+            if (length[s] <= 1)
+                continue;
+
+            if (kraft + (1U << (limit - length[s])) > max_kraft)
+                continue;
+
+            if ((best == -1) || (freq[s] > freq[best]))
+                best = s;
+        }
+
+        if (best != -1)
+        {
+            kraft += 1U << (limit - length[best]);
+            length[best]--;
+            changed = 1;
+        }
+    }
+}
+
+// Builds a canonical tree from the lengths of the codes and saves the codes of
+// each symbol. Returns the root node.
+static int huffman_canonical_tree(const int *length, int num_symbols, uint32_t *code)
+{
+    huff_num_nodes = 0;
+
+    int root = huff_new_node(0, -1, -1, -1);
+
+    uint32_t next_code = 0;
+    int prev_length = 0;
+
+    for (int len = 1; len <= HUFF_MAX_LENGTH; len++)
+    {
+        for (int s = 0; s < num_symbols; s++)
+        {
+            if (length[s] != len)
+                continue;
+
+            next_code <<= len - prev_length;
+            prev_length = len;
+
+            code[s] = next_code++;
+
+            int node = root;
+            for (int bit = len - 1; bit > 0; bit--)
+            {
+                int b = (code[s] >> bit) & 1;
+                if (huff_nodes[node].child[b] == -1)
+                {
+                    int child = huff_new_node(0, -1, -1, -1);
+                    huff_nodes[node].child[b] = child;
+                }
+                node = huff_nodes[node].child[b];
+            }
+
+            huff_nodes[node].child[code[s] & 1] = huff_new_node(0, -1, -1, s);
+        }
+    }
+
+    // If the code isn't complete, fill the holes with a symbol that is never
+    // used so that the tree is valid.
+    int num_nodes = huff_num_nodes;
+    for (int n = 0; n < num_nodes; n++)
+    {
+        if (huff_nodes[n].symbol >= 0)
+            continue;
+
+        for (int c = 0; c < 2; c++)
+        {
+            if (huff_nodes[n].child[c] == -1)
+                huff_nodes[n].child[c] = huff_new_node(0, -1, -1, 0);
+        }
+    }
+
+    return root;
+}
+
+// Stores the tree starting at dst + 5. It returns the number of pairs of nodes,
+// or 0 if the tree doesn't fit in the format.
+//
+// The children of a node can't be stored more than 63 pairs after the node.
+// Storing the tree in breadth-first order doesn't work for big trees because
+// too many nodes are waiting for their children at the same time. Instead, the
+// children of the last node that has been stored are stored next (depth-first)
+// unless a node is running out of time, in which case the node with the
+// closest deadline goes first.
+static int huffman_store_tree(int root, uint8_t *dst)
+{
+    uint8_t *tree = dst + 5;
+    int *pending = huff_pending;
+    int *position = huff_position;
+    int num_pending = 0;
+
+    pending[num_pending++] = root;
+    position[root] = 0;
+
+    int next_pair = 1;
+
+    while (num_pending > 0)
+    {
+        // The BIOS calculates the address of the children from the address
+        // of the node aligned to 2 bytes. The output buffer is aligned. This
+        // is the last value of next_pair that can be used for each node.
+        #define DEADLINE(n) \
+            ((((5 + position[n]) & ~1) + 2 + (0x3F * 2)) - 5)
+
+        int urgent = 0;
+        for (int i = 1; i < num_pending; i++)
+        {
+            if (DEADLINE(pending[i]) < DEADLINE(pending[urgent]))
+                urgent = i;
+        }
+
+        int index = num_pending - 1;
+        if (DEADLINE(pending[urgent]) - next_pair < num_pending * 2)
+            index = urgent;
+
+        int node = pending[index];
+        pending[index] = pending[--num_pending];
+
+        if (next_pair > DEADLINE(node))
+            return 0;
+
+        #undef DEADLINE
+
+        int node_addr = (5 + position[node]) & ~1;
+        int pair_addr = 5 + next_pair;
+        uint8_t info = (pair_addr - node_addr - 2) / 2;
+
+        for (int c = 0; c < 2; c++)
+        {
+            int child = huff_nodes[node].child[c];
+
+            if (huff_nodes[child].symbol >= 0)
+            {
+                tree[next_pair + c] = huff_nodes[child].symbol;
+                info |= (c == 0) ? 0x80 : 0x40;
+            }
+            else
+            {
+                position[child] = next_pair + c;
+                pending[num_pending++] = child;
+            }
+        }
+
+        tree[position[node]] = info;
+        next_pair += 2;
+    }
+
+    // The bitstream must be aligned to 4 bytes
+    int pairs = (next_pair - 1) / 2;
+    if ((pairs & 1) == 0)
+    {
+        tree[next_pair++] = 0;
+        tree[next_pair++] = 0;
+        pairs++;
+    }
+
+    return pairs;
+}
+
+size_t compress_huffman(const uint8_t *src, size_t size, uint8_t *dst,
+                        int bits)
+{
+    int num_symbols = 1 << bits;
+    size_t count = (bits == 8) ? size : size * 2;
+
+    uint32_t freq[HUFF_MAX_SYMBOLS] = { 0 };
+    for (size_t i = 0; i < count; i++)
+    {
+        int s = (bits == 8) ? src[i] : (src[i / 2] >> ((i & 1) * 4)) & 0xF;
+        freq[s]++;
+    }
+
+    int length[HUFF_MAX_SYMBOLS];
+    uint32_t code[HUFF_MAX_SYMBOLS];
+
+    huffman_lengths(freq, num_symbols, length);
+
+    int max_length = 0;
+    int used_symbols = 0;
+    for (int s = 0; s < num_symbols; s++)
+    {
+        if (length[s] > max_length)
+            max_length = length[s];
+        if (length[s] > 0)
+            used_symbols++;
+    }
+
+    if (max_length > HUFF_MAX_LENGTH)
+        max_length = HUFF_MAX_LENGTH;
+
+    int pairs = 0;
+
+    // The codes can't be shorter than what is needed for all symbols
+    for (int limit = max_length; (1 << limit) >= used_symbols; limit--)
+    {
+        huffman_limit_lengths(freq, num_symbols, length, limit);
+
+        int root = huffman_canonical_tree(length, num_symbols, code);
+
+        pairs = huffman_store_tree(root, dst);
+        if (pairs > 0)
+            break;
+    }
+
+    // The tree doesn't fit in the format used by the BIOS
+    if (pairs == 0)
+        return 0;
+
+    write_header(dst, size, 0x20 | bits);
+    dst[4] = pairs;
+
+    size_t out = 5 + 2 * pairs + 1;
+
+    // The bitstream is stored in 32-bit little endian words, starting from the
+    // most significant bit. 4-bit data starts with the low nibble of each byte.
+
+    uint32_t word = 0;
+    int word_bits = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int s = (bits == 8) ? src[i] : (src[i / 2] >> ((i & 1) * 4)) & 0xF;
+
+        for (int b = length[s] - 1; b >= 0; b--)
+        {
+            word |= ((code[s] >> b) & 1) << (31 - word_bits);
+            word_bits++;
+
+            if (word_bits == 32)
+            {
+                for (int k = 0; k < 4; k++)
+                    dst[out++] = word >> (k * 8);
+
+                word = 0;
+                word_bits = 0;
+            }
+        }
+    }
+
+    if (word_bits > 0)
+    {
+        for (int k = 0; k < 4; k++)
+            dst[out++] = word >> (k * 8);
+    }
+
+    return out;
+}
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+#ifndef GBACOMP_COMPRESS_H__
+#define GBACOMP_COMPRESS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of the buffer needed to compress size bytes in any of the formats. The
+// worst case is Huffman with 8-bit symbols, which can use up to 24 bits per
+// symbol, plus the tree.
+#define COMPRESS_MAX_OUTPUT_SIZE(size)  ((size) * 4 + 1024)
+
+// All functions return the size of the compressed data, padded to a multiple
+// of 4 bytes, or 0 on error. The size of the uncompressed data must fit in 24
+// bits.
+
+// If vram is 1, the data can be decompressed 16 bits at a time. This is needed
+// for SWI_LZ77UnCompReadNormalWrite16bit().
+size_t compress_lz77(const uint8_t *src, size_t size, uint8_t *dst, int vram);
+
+size_t compress_rle(const uint8_t *src, size_t size, uint8_t *dst);
+
+// bits must be 4 or 8
+size_t compress_huffman(const uint8_t *src, size_t size, uint8_t *dst,
+                        int bits);
+
+#endif // GBACOMP_COMPRESS_H__
@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+// Compressor that generates data that can be decompressed by the BIOS
+// functions SWI_LZ77UnCompReadNormalWrite8bit(),
+// SWI_LZ77UnCompReadNormalWrite16bit(), SWI_RLUnCompWram(),
+// SWI_RLUnCompVram() and SWI_HuffUnComp(). The encoders are in compress.c.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compress.h"
+
+// The size of the uncompressed data is stored in 24 bits
+#define MAX_INPUT_SIZE  (0xFFFFFF)
+
+void file_load(const char *path, uint8_t **buffer, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        printf("%s couldn't be opened!\n", path);
+        exit(1);
+    }
+
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+
+    if (*size == 0)
+    {
+        printf("Size of %s is 0!\n", path);
+        fclose(f);
+        exit(1);
+    }
+
+    if (*size > MAX_INPUT_SIZE)
+    {
+        printf("%s is too big to be compressed!\n", path);
+        fclose(f);
+        exit(1);
+    }
+
+    rewind(f);
+    *buffer = malloc(*size);
+    if (*buffer == NULL)
+    {
+        printf("Not enough memory to load %s!\n", path);
+        fclose(f);
+        exit(1);
+    }
+
+    if (fread(*buffer, *size, 1, f) != 1)
+    {
+        printf("Error while reading %s\n", path);
+        fclose(f);
+        exit(1);
+    }
+
+    fclose(f);
+}
+
+void file_save(const char *path, const uint8_t *buffer, size_t size)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+    {
+        printf("%s couldn't be opened!\n", path);
+        exit(1);
+    }
+
+    if (fwrite(buffer, size, 1, f) != 1)
+    {
+        printf("Error while writing %s\n", path);
+        fclose(f);
+        exit(1);
+    }
+
+    fclose(f);
+}
+
+void *safe_malloc(size_t size)
+{
+    void *p = malloc(size);
+    if (p == NULL)
+    {
+        printf("Not enough memory!\n");
+        exit(1);
+    }
+    return p;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        printf("Invalid arguments.\n"
+               "Usage: %s [mode] [file_in] [file_out]\n"
+               "\n"
+               "Modes:\n"
+               "  lz77      LZ77, for SWI_LZ77UnCompReadNormalWrite8bit()\n"
+               "  lz77vram  LZ77, for SWI_LZ77UnCompReadNormalWrite16bit()\n"
+               "  rle       Run-length encoding, for SWI_RLUnCompWram/Vram()\n"
+               "  huff4     Huffman with 4-bit symbols, for SWI_HuffUnComp()\n"
+               "  huff8     Huffman with 8-bit symbols, for SWI_HuffUnComp()\n",
+               argv[0]);
+        return 1;
+    }
+
+    const char *mode = argv[1];
+    const char *path_in = argv[2];
+    const char *path_out = argv[3];
+
+    uint8_t *src;
+    size_t size;
+
+    file_load(path_in, &src, &size);
+
+    uint8_t *dst = safe_malloc(COMPRESS_MAX_OUTPUT_SIZE(size));
+    size_t dst_size;
+
+    if (strcmp(mode, "lz77") == 0)
+    {
+        dst_size = compress_lz77(src, size, dst, 0);
+    }
+    else if (strcmp(mode, "lz77vram") == 0)
+    {
+        dst_size = compress_lz77(src, size, dst, 1);
+    }
+    else if (strcmp(mode, "rle") == 0)
+    {
+        dst_size = compress_rle(src, size, dst);
+    }
+    else if (strcmp(mode, "huff4") == 0)
+    {
+        dst_size = compress_huffman(src, size, dst, 4);
+    }
+    else if (strcmp(mode, "huff8") == 0)
+    {
+        dst_size = compress_huffman(src, size, dst, 8);
+    }
+    else
+    {
+        printf("Unknown mode: %s\n", mode);
+        return 1;
+    }
+
+    if (dst_size == 0)
+    {
+        printf("Failed to compress %s in mode %s\n", path_in, mode);
+        return 1;
+    }
+
+    file_save(path_out, dst, dst_size);
+
+    free(src);
+    free(dst);
+
+    return 0;
+}
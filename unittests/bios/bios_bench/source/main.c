@@ -0,0 +1,690 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+// Benchmark of the emulated BIOS services. It generates data with different
+// sizes and entropies, compresses it with the encoders of gbacomp, checks
+// that the emulated BIOS decoders return the original data and measures how
+// long they take.
+//
+// The results are printed to stdout as CSV so that they can be compared
+// between builds:
+//
+//     service,size,entropy,calls,ns_per_call,mb_per_s
+//
+// The size is the number of bytes generated by the service, and the speed is
+// measured in output bytes. Any mismatch is printed to stderr and makes the
+// test fail.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <ugba/ugba.h>
+
+#include "compress.h"
+
+#define MAX_SIZE            (256 * 1024)
+#define BUFFER_SIZE         COMPRESS_MAX_OUTPUT_SIZE(MAX_SIZE)
+
+// Minimum time that each measurement has to take to be considered valid
+#define MIN_CLOCKS          (CLOCKS_PER_SEC / 100)
+
+static const size_t sizes[] = { 1024, 16 * 1024, MAX_SIZE };
+#define NUM_SIZES           (sizeof(sizes) / sizeof(sizes[0]))
+
+typedef enum {
+    ENTROPY_LOW,
+    ENTROPY_MEDIUM,
+    ENTROPY_HIGH,
+
+    ENTROPY_NUMBER
+} entropy_type;
+
+static const char *entropy_name[ENTROPY_NUMBER] = {
+    "low", "medium", "high"
+};
+
+static uint8_t *original;
+static uint8_t *encoded;
+static uint8_t *decoded;
+
+static int failed = 0;
+
+// Data generation
+// ===============
+
+static uint32_t rng_state;
+
+static uint32_t Random(void)
+{
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// The seed depends on the arguments so that the results are always the same.
+static void Generate_Data(uint8_t *buf, size_t size, entropy_type entropy)
+{
+    rng_state = 0x12345678 ^ (size * 31) ^ (entropy << 24);
+
+    size_t i = 0;
+
+    switch (entropy)
+    {
+        case ENTROPY_LOW:
+        {
+            // Long runs of a few different values
+            while (i < size)
+            {
+                uint8_t value = Random() % 4;
+                size_t run = 8 + (Random() % 64);
+                while ((run-- > 0) && (i < size))
+                    buf[i++] = value;
+            }
+            break;
+        }
+        case ENTROPY_MEDIUM:
+        {
+            // Small alphabet, with half of the bytes copied from recent data
+            for ( ; i < size; i++)
+            {
+                uint32_t r = Random();
+                uint32_t distance = 1 + ((r >> 8) % 64);
+
+                if ((r & 1) && (i >= distance))
+                    buf[i] = buf[i - distance];
+                else
+                    buf[i] = (r >> 16) % 16;
+            }
+            break;
+        }
+        case ENTROPY_HIGH:
+        case ENTROPY_NUMBER:
+        {
+            for ( ; i < size; i++)
+                buf[i] = (Random() >> 8) & 0xFF;
+            break;
+        }
+    }
+}
+
+// Timing
+// ======
+
+typedef struct {
+    void (*run)(void *arg);
+    void *arg;
+} bench_call;
+
+// Returns the time per call in nanoseconds. The number of repetitions is
+// doubled until the measurement is long enough to be reliable.
+static double Bench_Run(bench_call *call, uint32_t *calls)
+{
+    uint32_t reps = 1;
+
+    while (1)
+    {
+        clock_t start = clock();
+
+        for (uint32_t i = 0; i < reps; i++)
+            call->run(call->arg);
+
+        clock_t elapsed = clock() - start;
+
+        if ((elapsed >= MIN_CLOCKS) || (reps >= (1U << 30)))
+        {
+            *calls = reps;
+            return ((double)elapsed * 1e9) / ((double)CLOCKS_PER_SEC * reps);
+        }
+
+        reps *= 2;
+    }
+}
+
+static void Bench_Print(const char *service, size_t size, const char *entropy,
+                        bench_call *call)
+{
+    uint32_t calls;
+    double ns = Bench_Run(call, &calls);
+    double mb_per_s = (ns > 0.0) ? ((double)size * 1000.0) / ns : 0.0;
+
+    printf("%s,%zu,%s,%u,%.1f,%.2f\n", service, size, entropy,
+           (unsigned int)calls, ns, mb_per_s);
+    fflush(stdout);
+}
+
+static void Report_Mismatch(const char *service, size_t size,
+                            const char *entropy, const uint8_t *expected,
+                            const uint8_t *result)
+{
+    size_t i = 0;
+    while ((i < size) && (expected[i] == result[i]))
+        i++;
+
+    fprintf(stderr, "%s,%zu,%s: Mismatch at offset %zu: %02X != %02X\n",
+            service, size, entropy, i, result[i], expected[i]);
+
+    failed = 1;
+}
+
+// Decompression
+// =============
+
+typedef struct {
+    const char *name;
+    void (*decode)(const void *source, void *dest);
+    int encoding; // 0x10, 0x24, 0x28, 0x30, 0x81, 0x82
+    int vram; // 1 if the decoder writes 16 bits at a time
+} decoder_info;
+
+static const decoder_info decoders[] = {
+    { "lz77_wram", SWI_LZ77UnCompReadNormalWrite8bit, 0x10, 0 },
+    { "lz77_vram", SWI_LZ77UnCompReadNormalWrite16bit, 0x10, 1 },
+    { "huff4", SWI_HuffUnComp, 0x24, 0 },
+    { "huff8", SWI_HuffUnComp, 0x28, 0 },
+    { "rle_wram", SWI_RLUnCompWram, 0x30, 0 },
+    { "rle_vram", SWI_RLUnCompVram, 0x30, 1 },
+    { "diff8_wram", SWI_Diff8bitUnFilterWram, 0x81, 0 },
+    { "diff8_vram", SWI_Diff8bitUnFilterVram, 0x81, 1 },
+    { "diff16", SWI_Diff16bitUnFilter, 0x82, 1 },
+};
+
+#define NUM_DECODERS        (sizeof(decoders) / sizeof(decoders[0]))
+
+static const decoder_info *decoder_current;
+
+static void Run_Decoder(void *arg)
+{
+    (void)arg;
+    decoder_current->decode(encoded, decoded);
+}
+
+// gbacomp doesn't support the difference filters, they are simple enough to
+// generate them here.
+static size_t Encode_Diff(const uint8_t *src, size_t size, uint8_t *dst,
+                          int bits)
+{
+    uint32_t header = ((uint32_t)size << 8) | 0x80 | (bits / 8);
+
+    for (int i = 0; i < 4; i++)
+        dst[i] = header >> (i * 8);
+
+    size_t out = 4;
+
+    if (bits == 8)
+    {
+        uint8_t last = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            dst[out++] = src[i] - last;
+            last = src[i];
+        }
+    }
+    else
+    {
+        uint16_t last = 0;
+        for (size_t i = 0; i + 1 < size; i += 2)
+        {
+            uint16_t value = src[i] | (src[i + 1] << 8);
+            uint16_t diff = value - last;
+            dst[out++] = diff & 0xFF;
+            dst[out++] = diff >> 8;
+            last = value;
+        }
+    }
+
+    while (out & 3)
+        dst[out++] = 0;
+
+    return out;
+}
+
+static size_t Encode(const decoder_info *info, size_t size)
+{
+    switch (info->encoding)
+    {
+        case 0x10:
+            return compress_lz77(original, size, encoded, info->vram);
+        case 0x24:
+            return compress_huffman(original, size, encoded, 4);
+        case 0x28:
+            return compress_huffman(original, size, encoded, 8);
+        case 0x30:
+            return compress_rle(original, size, encoded);
+        case 0x81:
+            return Encode_Diff(original, size, encoded, 8);
+        case 0x82:
+            return Encode_Diff(original, size, encoded, 16);
+        default:
+            return 0;
+    }
+}
+
+static void Bench_Decoders(void)
+{
+    for (size_t d = 0; d < NUM_DECODERS; d++)
+    {
+        const decoder_info *info = &decoders[d];
+
+        for (size_t s = 0; s < NUM_SIZES; s++)
+        {
+            size_t size = sizes[s];
+
+            for (int e = 0; e < ENTROPY_NUMBER; e++)
+            {
+                Generate_Data(original, size, e);
+
+                if (Encode(info, size) == 0)
+                {
+                    fprintf(stderr, "%s,%zu,%s: Failed to encode data\n",
+                            info->name, size, entropy_name[e]);
+                    failed = 1;
+                    continue;
+                }
+
+                memset(decoded, 0, size);
+
+                info->decode(encoded, decoded);
+
+                if (memcmp(original, decoded, size) != 0)
+                {
+                    Report_Mismatch(info->name, size, entropy_name[e],
+                                    original, decoded);
+                    continue;
+                }
+
+                decoder_current = info;
+
+                bench_call call = { Run_Decoder, NULL };
+                Bench_Print(info->name, size, entropy_name[e], &call);
+            }
+        }
+    }
+}
+
+// Bit unpacking
+// =============
+
+// Straightforward implementation that handles one bit at a time
+static void Reference_BitUnPack(const uint8_t *src, uint8_t *dst,
+                                const bit_unpack_info *info)
+{
+    uint32_t offset = info->data_offset & ~SWI_BITUNPACK_OFFSET_ZERO;
+    int zero_flag = (info->data_offset & SWI_BITUNPACK_OFFSET_ZERO) ? 1 : 0;
+
+    size_t units = ((size_t)info->source_length * 8) / info->source_width;
+
+    uint32_t word = 0;
+    int word_bits = 0;
+
+    for (size_t i = 0; i < units; i++)
+    {
+        uint32_t value = 0;
+
+        for (int b = 0; b < info->source_width; b++)
+        {
+            size_t bit = i * info->source_width + b;
+            value |= ((src[bit / 8] >> (bit % 8)) & 1) << b;
+        }
+
+        if ((value != 0) || zero_flag)
+            value += offset;
+
+        word |= value << word_bits;
+        word_bits += info->dest_width;
+
+        if (word_bits == 32)
+        {
+            for (int b = 0; b < 4; b++)
+                *dst++ = word >> (b * 8);
+
+            word = 0;
+            word_bits = 0;
+        }
+    }
+}
+
+static const bit_unpack_info *bitunpack_current;
+
+static void Run_BitUnPack(void *arg)
+{
+    (void)arg;
+    SWI_BitUnPack(original, decoded, bitunpack_current);
+}
+
+static void Bench_BitUnPack(void)
+{
+    static const struct {
+        uint8_t source_width;
+        uint8_t dest_width;
+        uint32_t data_offset;
+    } formats[] = {
+        { 1, 4, 0 },
+        { 1, 8, 1 },
+        { 2, 4, 0 },
+        { 2, 8, SWI_BITUNPACK_OFFSET_ZERO | 3 },
+        { 4, 8, 0 },
+        { 8, 32, 0x100 },
+    };
+
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "bitunpack_%u_%u",
+                 formats[f].source_width, formats[f].dest_width);
+
+        for (size_t s = 0; s < NUM_SIZES; s++)
+        {
+            // The source length is a 16-bit signed value. The speed is
+            // measured in output bytes, like with the other services.
+            size_t source_length = sizes[s];
+            if (source_length > 0x7FFC)
+                source_length = 0x7FFC;
+
+            size_t size = (source_length * 8 / formats[f].source_width)
+                        * formats[f].dest_width / 8;
+
+            bit_unpack_info info = {
+                .source_length = source_length,
+                .source_width = formats[f].source_width,
+                .dest_width = formats[f].dest_width,
+                .data_offset = formats[f].data_offset
+            };
+
+            for (int e = 0; e < ENTROPY_NUMBER; e++)
+            {
+                Generate_Data(original, source_length, e);
+
+                Reference_BitUnPack(original, encoded, &info);
+
+                memset(decoded, 0, size);
+
+                SWI_BitUnPack(original, decoded, &info);
+
+                if (memcmp(encoded, decoded, size) != 0)
+                {
+                    Report_Mismatch(name, size, entropy_name[e], encoded,
+                                    decoded);
+                    continue;
+                }
+
+                bitunpack_current = &info;
+
+                bench_call call = { Run_BitUnPack, NULL };
+                Bench_Print(name, size, entropy_name[e], &call);
+            }
+        }
+    }
+}
+
+// Memory copy and fill
+// ====================
+
+typedef struct {
+    void (*function)(const void *src, void *dst, uint32_t len_mode);
+    uint32_t len_mode;
+} cpuset_args;
+
+static void Run_CpuSet(void *arg)
+{
+    cpuset_args *args = arg;
+    args->function(original, decoded, args->len_mode);
+}
+
+static void Bench_CpuSet(void)
+{
+    static const struct {
+        const char *name;
+        void (*function)(const void *src, void *dst, uint32_t len_mode);
+        uint32_t mode;
+        int unit; // Size of the unit of len in bytes
+    } modes[] = {
+        { "cpuset_copy16", SWI_CpuSet, SWI_MODE_COPY | SWI_MODE_16BIT, 2 },
+        { "cpuset_copy32", SWI_CpuSet, SWI_MODE_COPY | SWI_MODE_32BIT, 4 },
+        { "cpuset_fill16", SWI_CpuSet, SWI_MODE_FILL | SWI_MODE_16BIT, 2 },
+        { "cpuset_fill32", SWI_CpuSet, SWI_MODE_FILL | SWI_MODE_32BIT, 4 },
+        { "cpufastset_copy", SWI_CpuFastSet, SWI_MODE_COPY, 4 },
+        { "cpufastset_fill", SWI_CpuFastSet, SWI_MODE_FILL, 4 },
+    };
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    {
+        for (size_t s = 0; s < NUM_SIZES; s++)
+        {
+            size_t size = sizes[s];
+
+            Generate_Data(original, size, ENTROPY_HIGH);
+
+            // Expected result
+            if (modes[m].mode & SWI_MODE_FILL)
+            {
+                for (size_t i = 0; i < size; i += modes[m].unit)
+                    memcpy(&encoded[i], original, modes[m].unit);
+            }
+            else
+            {
+                memcpy(encoded, original, size);
+            }
+
+            memset(decoded, 0, size);
+
+            cpuset_args args = {
+                modes[m].function, modes[m].mode | (size / modes[m].unit)
+            };
+
+            Run_CpuSet(&args);
+
+            if (memcmp(encoded, decoded, size) != 0)
+            {
+                Report_Mismatch(modes[m].name, size, "-", encoded, decoded);
+                continue;
+            }
+
+            bench_call call = { Run_CpuSet, &args };
+            Bench_Print(modes[m].name, size, "-", &call);
+        }
+    }
+}
+
+// Arithmetic
+// ==========
+
+#define MATHS_INPUTS        (1024)
+
+static int32_t maths_a[MATHS_INPUTS];
+static int32_t maths_b[MATHS_INPUTS];
+static volatile int32_t maths_sink;
+
+static void Run_Div(void *arg)
+{
+    (void)arg;
+    int32_t sum = 0;
+    for (int i = 0; i < MATHS_INPUTS; i++)
+        sum += SWI_Div(maths_a[i], maths_b[i]);
+    maths_sink = sum;
+}
+
+static void Run_DivMod(void *arg)
+{
+    (void)arg;
+    int32_t sum = 0;
+    for (int i = 0; i < MATHS_INPUTS; i++)
+    {
+        sum += SWI_Div(maths_a[i], maths_b[i]);
+        sum += SWI_DivMod(maths_a[i], maths_b[i]);
+    }
+    maths_sink = sum;
+}
+
+static void Run_DivAndMod(void *arg)
+{
+    (void)arg;
+    int32_t sum = 0;
+    for (int i = 0; i < MATHS_INPUTS; i++)
+    {
+        int32_t mod;
+        sum += SWI_DivAndMod(maths_a[i], maths_b[i], &mod);
+        sum += mod;
+    }
+    maths_sink = sum;
+}
+
+static void Run_Sqrt(void *arg)
+{
+    (void)arg;
+    int32_t sum = 0;
+    for (int i = 0; i < MATHS_INPUTS; i++)
+        sum += SWI_Sqrt(maths_a[i]);
+    maths_sink = sum;
+}
+
+static void Run_ArcTan(void *arg)
+{
+    (void)arg;
+    int32_t sum = 0;
+    for (int i = 0; i < MATHS_INPUTS; i++)
+        sum += SWI_ArcTan(maths_a[i]);
+    maths_sink = sum;
+}
+
+static void Run_ArcTan2(void *arg)
+{
+    (void)arg;
+    int32_t sum = 0;
+    for (int i = 0; i < MATHS_INPUTS; i++)
+        sum += SWI_ArcTan2(maths_a[i], maths_b[i]);
+    maths_sink = sum;
+}
+
+static uint32_t Reference_Sqrt(uint32_t value)
+{
+    uint32_t result = 0;
+    uint32_t bit = 1U << 30;
+
+    while (bit > value)
+        bit >>= 2;
+
+    while (bit != 0)
+    {
+        if (value >= result + bit)
+        {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        }
+        else
+        {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return result;
+}
+
+static void Bench_Maths(void)
+{
+    // The time is reported per call, not per batch of inputs
+
+    rng_state = 0xCAFEF00D;
+
+    for (int i = 0; i < MATHS_INPUTS; i++)
+    {
+        maths_a[i] = Random() >> 1;
+        maths_b[i] = (Random() >> (1 + (Random() % 31))) | 1;
+        if (Random() & 1)
+            maths_b[i] = -maths_b[i];
+
+        if (SWI_Div(maths_a[i], maths_b[i]) != maths_a[i] / maths_b[i])
+        {
+            fprintf(stderr, "div: %d / %d: %d != %d\n", maths_a[i],
+                    maths_b[i], SWI_Div(maths_a[i], maths_b[i]),
+                    maths_a[i] / maths_b[i]);
+            failed = 1;
+        }
+
+        if (SWI_Sqrt(maths_a[i]) != Reference_Sqrt(maths_a[i]))
+        {
+            fprintf(stderr, "sqrt: %d: %u != %u\n", maths_a[i],
+                    SWI_Sqrt(maths_a[i]), Reference_Sqrt(maths_a[i]));
+            failed = 1;
+        }
+    }
+
+    static const struct {
+        const char *name;
+        void (*run)(void *arg);
+    } functions[] = {
+        { "div", Run_Div },
+        { "div+divmod", Run_DivMod },
+        { "divandmod", Run_DivAndMod },
+        { "sqrt", Run_Sqrt },
+    };
+
+    for (size_t f = 0; f < sizeof(functions) / sizeof(functions[0]); f++)
+    {
+        bench_call call = { functions[f].run, NULL };
+        uint32_t calls;
+        double ns = Bench_Run(&call, &calls) / MATHS_INPUTS;
+
+        printf("%s,0,-,%u,%.2f,0.00\n", functions[f].name,
+               (unsigned int)calls * MATHS_INPUTS, ns);
+    }
+
+    // SWI_ArcTan() and SWI_ArcTan2() take 16-bit values
+    for (int i = 0; i < MATHS_INPUTS; i++)
+    {
+        maths_a[i] = (int16_t)Random();
+        maths_b[i] = (int16_t)Random();
+    }
+
+    static const struct {
+        const char *name;
+        void (*run)(void *arg);
+    } arctan_functions[] = {
+        { "arctan", Run_ArcTan },
+        { "arctan2", Run_ArcTan2 },
+    };
+
+    for (size_t f = 0; f < sizeof(arctan_functions) /
+                           sizeof(arctan_functions[0]); f++)
+    {
+        bench_call call = { arctan_functions[f].run, NULL };
+        uint32_t calls;
+        double ns = Bench_Run(&call, &calls) / MATHS_INPUTS;
+
+        printf("%s,0,-,%u,%.2f,0.00\n", arctan_functions[f].name,
+               (unsigned int)calls * MATHS_INPUTS, ns);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    UGBA_InitHeadless(&argc, &argv);
+
+    original = malloc(BUFFER_SIZE);
+    encoded = malloc(BUFFER_SIZE);
+    decoded = malloc(BUFFER_SIZE);
+
+    if ((original == NULL) || (encoded == NULL) || (decoded == NULL))
+    {
+        fprintf(stderr, "Not enough memory\n");
+        return 1;
+    }
+
+    printf("service,size,entropy,calls,ns_per_call,mb_per_s\n");
+
+    Bench_Decoders();
+    Bench_BitUnPack();
+    Bench_CpuSet();
+    Bench_Maths();
+
+    free(original);
+    free(encoded);
+    free(decoded);
+
+    return failed;
+}
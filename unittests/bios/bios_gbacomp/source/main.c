@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+// Test that checks that the files compressed by gbacomp during the build can be
+// decompressed by the BIOS functions. All the files in the data folder have the
+// same contents, and the extension selects the compression format.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <ugba/ugba.h>
+
+#include "sample_bin.h"
+#include "sample_huff4.h"
+#include "sample_huff8.h"
+#include "sample_lz77.h"
+#include "sample_lz77vram.h"
+#include "sample_rle.h"
+
+// 16 K buffer aligned to 32 bit
+static uint32_t buffer[(16 * 1024) / sizeof(uint32_t)];
+
+static int failed = 0;
+
+static void Check_Decompress(const char *name, const uint8_t *src,
+                             void (*decompress)(const void *, void *))
+{
+    // The header holds the size of the decompressed data
+    uint32_t size = (src[1] | (src[2] << 8) | (src[3] << 16));
+
+    if (size != sample_bin_size)
+    {
+        fprintf(stderr, "%s: Invalid size: %u != %zu\n", name, size,
+                (size_t)sample_bin_size);
+        failed = 1;
+        return;
+    }
+
+    memset(&(buffer[0]), 0, sizeof(buffer));
+    decompress(src, &(buffer[0]));
+
+    if (memcmp(&(buffer[0]), &(sample_bin[0]), sample_bin_size) != 0)
+    {
+        fprintf(stderr, "%s: Invalid data\n", name);
+        failed = 1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    UGBA_InitHeadless(&argc, &argv);
+
+    Check_Decompress("lz77", sample_lz77,
+                     SWI_LZ77UnCompReadNormalWrite8bit);
+    Check_Decompress("lz77vram (8 bit)", sample_lz77vram,
+                     SWI_LZ77UnCompReadNormalWrite8bit);
+    Check_Decompress("lz77vram (16 bit)", sample_lz77vram,
+                     SWI_LZ77UnCompReadNormalWrite16bit);
+    Check_Decompress("rle (WRAM)", sample_rle, SWI_RLUnCompWram);
+    Check_Decompress("rle (VRAM)", sample_rle, SWI_RLUnCompVram);
+    Check_Decompress("huff4", sample_huff4, SWI_HuffUnComp);
+    Check_Decompress("huff8", sample_huff8, SWI_HuffUnComp);
+
+    return failed;
+}
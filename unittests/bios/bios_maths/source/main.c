@@ -0,0 +1,337 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+// Test that checks that the emulated maths functions of the BIOS return exactly
+// the same values as reference implementations. The arc tangent functions are
+// compared against the polynomial used by the BIOS for all possible tangents
+// and for a sample of all possible pairs of coordinates. The square root is
+// checked around all perfect squares, which is where a wrong rounding would
+// show up. The object affine matrices are compared against the scalar code
+// that calculates one matrix at a time, which also checks the SIMD code.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <ugba/ugba.h>
+
+static int failed = 0;
+
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t Random(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// Division
+// ========
+
+static void Check_Div(int32_t num, int32_t div)
+{
+    int32_t quot, mod;
+
+    if (div == 0)
+    {
+        quot = 0;
+        mod = 0;
+    }
+    else if (div == -1)
+    {
+        quot = (num == INT32_MIN) ? INT32_MIN : -num;
+        mod = 0;
+    }
+    else
+    {
+        quot = num / div;
+        mod = num % div;
+    }
+
+    int32_t both_mod;
+    int32_t both_quot = SWI_DivAndMod(num, div, &both_mod);
+
+    if ((SWI_Div(num, div) != quot) || (SWI_DivMod(num, div) != mod) ||
+        (both_quot != quot) || (both_mod != mod))
+    {
+        fprintf(stderr, "div: %d / %d: %d %d %d %d != %d %d\n", num, div,
+                SWI_Div(num, div), SWI_DivMod(num, div), both_quot, both_mod,
+                quot, mod);
+        failed = 1;
+    }
+}
+
+static void Test_Div(void)
+{
+    static const int32_t values[] = {
+        0, 1, -1, 2, -2, 3, -3, 7, -7, 255, -256, 0x7FFF, -0x8000,
+        INT32_MAX, INT32_MAX - 1, INT32_MIN, INT32_MIN + 1
+    };
+    const size_t num_values = sizeof(values) / sizeof(values[0]);
+
+    for (size_t i = 0; i < num_values; i++)
+    {
+        for (size_t j = 0; j < num_values; j++)
+            Check_Div(values[i], values[j]);
+    }
+
+    for (int i = 0; i < 1000000; i++)
+    {
+        int32_t num = (int32_t)Random() >> (Random() % 32);
+        int32_t div = (int32_t)Random() >> (Random() % 32);
+        Check_Div(num, div);
+    }
+}
+
+// Square root
+// ===========
+
+static void Check_Sqrt(uint32_t value, uint32_t expected)
+{
+    if (SWI_Sqrt(value) != expected)
+    {
+        fprintf(stderr, "sqrt: %u: %u != %u\n", value, SWI_Sqrt(value),
+                expected);
+        failed = 1;
+    }
+}
+
+static void Test_Sqrt(void)
+{
+    for (uint32_t i = 1; i <= 0xFFFF; i++)
+    {
+        uint32_t square = i * i;
+
+        Check_Sqrt(square - 1, i - 1);
+        Check_Sqrt(square, i);
+        Check_Sqrt(square + 1, i);
+    }
+
+    Check_Sqrt(0, 0);
+    Check_Sqrt(UINT32_MAX, 0xFFFF);
+}
+
+// Arc tangent
+// ===========
+
+// This is the polynomial used by the BIOS
+static int16_t Reference_ArcTan(int16_t tan)
+{
+    int32_t r0 = tan;
+    int32_t r1 = -((r0 * r0) >> 14);
+    int32_t r3 = ((((int32_t)0xA9) * r1) >> 14) + 0x390;
+    r3 = ((r1 * r3) >> 14) + 0x91C;
+    r3 = ((r1 * r3) >> 14) + 0xFB6;
+    r3 = ((r1 * r3) >> 14) + 0x16AA;
+    r3 = ((r1 * r3) >> 14) + 0x2081;
+    r3 = ((r1 * r3) >> 14) + 0x3651;
+    r3 = ((r1 * r3) >> 14) + 0xA259;
+    return (r0 * r3) >> 16;
+}
+
+static int16_t Reference_ArcTan2(int16_t x, int16_t y)
+{
+    int32_t x_ = x;
+    int32_t y_ = y;
+
+    if (y_ == 0)
+        return (x_ < 0) ? (int16_t)0x8000 : 0;
+
+    if (x_ == 0)
+        return (y_ < 0) ? (int16_t)0xC000 : 0x4000;
+
+    if (y_ >= 0)
+    {
+        if (x_ >= 0)
+        {
+            if (x_ < y_)
+                return 0x4000 - Reference_ArcTan((x_ << 14) / y_);
+
+            return Reference_ArcTan((y_ << 14) / x_);
+        }
+
+        if (-x_ < y_)
+            return 0x4000 - Reference_ArcTan((x_ << 14) / y_);
+
+        return 0x8000 + Reference_ArcTan((y_ << 14) / x_);
+    }
+
+    if (x_ > 0)
+    {
+        if (x_ < -y_)
+            return 0xC000 - Reference_ArcTan((x_ << 14) / y_);
+
+        return 0x10000 + Reference_ArcTan((y_ << 14) / x_);
+    }
+
+    if (-x_ > -y_)
+        return 0x8000 + Reference_ArcTan((y_ << 14) / x_);
+
+    return 0xC000 - Reference_ArcTan((x_ << 14) / y_);
+}
+
+static void Check_ArcTan2(int16_t x, int16_t y)
+{
+    if (SWI_ArcTan2(x, y) != Reference_ArcTan2(x, y))
+    {
+        fprintf(stderr, "arctan2: %d, %d: %d != %d\n", x, y,
+                SWI_ArcTan2(x, y), Reference_ArcTan2(x, y));
+        failed = 1;
+    }
+}
+
+static void Test_ArcTan(void)
+{
+    for (int32_t i = INT16_MIN; i <= INT16_MAX; i++)
+    {
+        if (SWI_ArcTan(i) != Reference_ArcTan(i))
+        {
+            fprintf(stderr, "arctan: %d: %d != %d\n", i, SWI_ArcTan(i),
+                    Reference_ArcTan(i));
+            failed = 1;
+        }
+    }
+
+    // All small coordinates, which are the most common ones
+    for (int32_t y = -256; y <= 256; y++)
+    {
+        for (int32_t x = -256; x <= 256; x++)
+            Check_ArcTan2(x, y);
+    }
+
+    // A sample of the whole range of coordinates, including the bounds
+    for (int32_t y = INT16_MIN; y <= INT16_MAX; y += 61)
+    {
+        for (int32_t x = INT16_MIN; x <= INT16_MAX; x += 59)
+            Check_ArcTan2(x, y);
+
+        Check_ArcTan2(INT16_MAX, y);
+        Check_ArcTan2(y, INT16_MAX);
+    }
+
+    for (int i = 0; i < 1000000; i++)
+        Check_ArcTan2(Random(), Random());
+}
+
+// Object affine matrices
+// =======================
+
+// This is the code that calculates the matrix of one object
+static void Reference_ObjAffineSet(const obj_affine_src *src, int16_t *dst,
+                                   uint32_t count, uint32_t increment)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        float sx = ((float)src->sx) / (float)(1 << 8);
+        float sy = ((float)src->sy) / (float)(1 << 8);
+        float angle = (float)2.0 * (float)M_PI
+                      * (((float)(uint8_t)(src->angle >> 8)) / (float)0xFF);
+        src++;
+
+        float sin_ = sin(angle);
+        float cos_ = cos(angle);
+
+        *dst = (int16_t)(cos_ * (float)(1 << 8) * sx);
+        dst += increment / 2;
+        *dst = (int16_t)(-sin_ * (float)(1 << 8) * sx);
+        dst += increment / 2;
+        *dst = (int16_t)(sin_ * (float)(1 << 8) * sy);
+        dst += increment / 2;
+        *dst = (int16_t)(cos_ * (float)(1 << 8) * sy);
+        dst += increment / 2;
+    }
+}
+
+#define OBJ_AFFINE_SCALES   (8)
+#define OBJ_AFFINE_INPUTS   (256 * OBJ_AFFINE_SCALES * 2)
+
+static obj_affine_src obj_affine_in[OBJ_AFFINE_INPUTS];
+
+// Space for the biggest increment tested (8 bytes)
+static int16_t obj_affine_out[OBJ_AFFINE_INPUTS * 4 * 4];
+static int16_t obj_affine_ref[OBJ_AFFINE_INPUTS * 4 * 4];
+
+static void Check_ObjAffineSet(uint32_t start, uint32_t count,
+                               uint32_t increment)
+{
+    size_t size = count * 4 * (increment / 2) * sizeof(int16_t);
+
+    memset(obj_affine_out, 0, size);
+    memset(obj_affine_ref, 0, size);
+
+    SWI_ObjAffineSet(&obj_affine_in[start], obj_affine_out, count, increment);
+    Reference_ObjAffineSet(&obj_affine_in[start], obj_affine_ref, count,
+                           increment);
+
+    if (memcmp(obj_affine_out, obj_affine_ref, size) != 0)
+    {
+        fprintf(stderr, "objaffineset: start %u, count %u, increment %u\n",
+                start, count, increment);
+        failed = 1;
+    }
+}
+
+static void Test_ObjAffineSet(void)
+{
+    static const int16_t scales[OBJ_AFFINE_SCALES] = {
+        0, 1, 256, -256, 0x7FFF, -0x7FFF, -0x8000, 0x1234
+    };
+
+    // All angles with all scales, followed by random values
+    uint32_t n = 0;
+
+    for (uint32_t angle = 0; angle < 256; angle++)
+    {
+        for (int i = 0; i < OBJ_AFFINE_SCALES; i++)
+        {
+            obj_affine_in[n].sx = scales[i];
+            obj_affine_in[n].sy = scales[OBJ_AFFINE_SCALES - 1 - i];
+            obj_affine_in[n].angle = (angle << 8) | (Random() & 0xFF);
+            n++;
+        }
+    }
+
+    for ( ; n < OBJ_AFFINE_INPUTS; n++)
+    {
+        obj_affine_in[n].sx = Random();
+        obj_affine_in[n].sy = Random();
+        obj_affine_in[n].angle = Random();
+    }
+
+    static const uint32_t increments[] = { 2, 8 };
+
+    for (size_t i = 0; i < sizeof(increments) / sizeof(increments[0]); i++)
+    {
+        uint32_t increment = increments[i];
+
+        // Everything at once, which mostly uses blocks of 4 matrices
+        Check_ObjAffineSet(0, OBJ_AFFINE_INPUTS, increment);
+
+        // Small counts, with and without leftover matrices
+        for (uint32_t count = 1; count <= 9; count++)
+        {
+            for (uint32_t start = 0; start + count <= OBJ_AFFINE_INPUTS;
+                 start += 97)
+                Check_ObjAffineSet(start, count, increment);
+        }
+
+        // Counts that don't fit in the internal blocks
+        Check_ObjAffineSet(3, 33, increment);
+        Check_ObjAffineSet(5, OBJ_AFFINE_INPUTS - 7, increment);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    UGBA_InitHeadless(&argc, &argv);
+
+    Test_Div();
+    Test_Sqrt();
+    Test_ArcTan();
+    Test_ObjAffineSet();
+
+    return failed;
+}
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2021 Antonio Niño Díaz
+
+// Benchmark of the sine and cosine functions of the library. The results are
+// printed to stdout as CSV so that they can be compared between builds:
+//
+//     function,calls,ns_per_call
+//
+// The time is reported per angle, also for the functions that handle arrays.
+
+#include <stdio.h>
+#include <time.h>
+
+#include <ugba/ugba.h>
+
+// Minimum time that each measurement has to take to be considered valid
+#define MIN_CLOCKS          (CLOCKS_PER_SEC / 50)
+
+#define NUM_ANGLES          (1024)
+
+static int32_t angles[NUM_ANGLES];
+static int32_t sines[NUM_ANGLES];
+static int32_t cosines[NUM_ANGLES];
+
+static void Run_Sin(void)
+{
+    for (int i = 0; i < NUM_ANGLES; i++)
+        sines[i] = FP_Sin(angles[i]);
+}
+
+static void Run_Cos(void)
+{
+    for (int i = 0; i < NUM_ANGLES; i++)
+        cosines[i] = FP_Cos(angles[i]);
+}
+
+static void Run_SinAndCos(void)
+{
+    for (int i = 0; i < NUM_ANGLES; i++)
+    {
+        sines[i] = FP_Sin(angles[i]);
+        cosines[i] = FP_Cos(angles[i]);
+    }
+}
+
+static void Run_SinCos(void)
+{
+    for (int i = 0; i < NUM_ANGLES; i++)
+        FP_SinCos(angles[i], &sines[i], &cosines[i]);
+}
+
+static void Run_SinCosArray(void)
+{
+    FP_SinCosArray(angles, sines, cosines, NUM_ANGLES);
+}
+
+static void Run_SinArray(void)
+{
+    FP_SinCosArray(angles, sines, NULL, NUM_ANGLES);
+}
+
+static void Bench_Print(const char *name, void (*run)(void))
+{
+    uint32_t reps = 1;
+
+    while (1)
+    {
+        clock_t start = clock();
+
+        for (uint32_t i = 0; i < reps; i++)
+            run();
+
+        clock_t elapsed = clock() - start;
+
+        if ((elapsed >= MIN_CLOCKS) || (reps >= (1U << 24)))
+        {
+            double ns = ((double)elapsed * 1e9)
+                      / ((double)CLOCKS_PER_SEC * reps * NUM_ANGLES);
+
+            printf("%s,%u,%.2f\n", name, (unsigned int)(reps * NUM_ANGLES),
+                   ns);
+            return;
+        }
+
+        reps *= 2;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    UGBA_InitHeadless(&argc, &argv);
+
+    // Angles spread over several circles, including negative ones
+    uint32_t seed = 0x12345678;
+    for (int i = 0; i < NUM_ANGLES; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        angles[i] = (int32_t)(seed >> 12) - (1 << 19);
+    }
+
+    printf("function,calls,ns_per_call\n");
+
+    Bench_Print("sin", Run_Sin);
+    Bench_Print("cos", Run_Cos);
+    Bench_Print("sin+cos", Run_SinAndCos);
+    Bench_Print("sincos", Run_SinCos);
+    Bench_Print("sincos_array", Run_SinCosArray);
+    Bench_Print("sin_array", Run_SinArray);
+
+    return 0;
+}
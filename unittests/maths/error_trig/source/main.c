@@ -1,9 +1,10 @@
 // SPDX-License-Identifier: MIT
 //
-// Copyright (c) 2020 Antonio Niño Díaz
+// Copyright (c) 2020-2021 Antonio Niño Díaz
 
 // Test that makes sure that the sine and cosine implementations in the library
-// have an error lower than the expected one.
+// have an error lower than the expected one, and that FP_SinCos() and
+// FP_SinCosArray() return the same values as FP_Sin() and FP_Cos().
 
 #include <math.h>
 #include <stdio.h>
@@ -104,5 +105,32 @@ int main(int argc, char *argv[])
         }
     }
 
+    // Make sure that the functions that calculate the sine and the cosine at
+    // the same time give the same results as FP_Sin() and FP_Cos()
+
+    static int32_t angles[1024], sines[1024], cosines[1024];
+
+    for (int32_t x = -FP_2_PI; x < 2 * FP_2_PI; x += 1024)
+    {
+        for (int32_t i = 0; i < 1024; i++)
+            angles[i] = x + i;
+
+        FP_SinCosArray(angles, sines, cosines, 1024);
+
+        for (int32_t i = 0; i < 1024; i++)
+        {
+            int32_t s, c;
+            FP_SinCos(angles[i], &s, &c);
+
+            if ((s != sin_approx(angles[i])) || (sines[i] != s) ||
+                (c != cos_approx(angles[i])) || (cosines[i] != c))
+            {
+                printf("sincos(%X): Sin = %08X | Cos = %08X\n",
+                       angles[i], s, c);
+                failed = 1;
+            }
+        }
+    }
+
     return failed;
 }